@@ -0,0 +1,97 @@
+#!/usr/bin/env python
+"""
+Compares the evaluation speed of many swingTwist nodes against a single swingTwistArray node
+and the build time of creating swingTwist nodes one command at a time against a single batch
+command.
+
+Run with mayapy with the cmt module on the MAYA_MODULE_PATH.
+
+Usage:
+mayapy benchmarkswingtwist.py -c 500 -f 200
+"""
+import argparse
+import time
+
+
+def build_rig(count, use_array):
+    import maya.cmds as cmds
+    import cmt.rig.swingtwist as st
+
+    cmds.file(new=True, force=True)
+    cmds.select(clear=True)
+    driver = cmds.joint(name="driver")
+    pairs = []
+    for i in range(count):
+        cmds.select(clear=True)
+        driven = cmds.joint(name="driven{}".format(i), p=(i * 0.1, 0, 0))
+        pairs.append((driver, driven))
+    if use_array:
+        st.create_swing_twist_array(pairs, twist_weight=0.5, swing_weight=0.5)
+    else:
+        for driver, driven in pairs:
+            cmds.swingTwist(driver, driven, twist=0.5, swing=0.5)
+    cmds.setKeyframe(driver, attribute="rotate", t=1, v=0)
+    cmds.setKeyframe(driver, attribute="rotateX", t=100, v=170)
+    cmds.setKeyframe(driver, attribute="rotateY", t=100, v=60)
+    return [driven for _, driven in pairs]
+
+
+def measure_build(count, batch):
+    import maya.cmds as cmds
+    import cmt.rig.swingtwist as st
+
+    cmds.file(new=True, force=True)
+    cmds.select(clear=True)
+    driver = cmds.joint(name="driver")
+    pairs = []
+    for i in range(count):
+        cmds.select(clear=True)
+        driven = cmds.joint(name="driven{}".format(i), p=(i * 0.1, 0, 0))
+        pairs.append((driver, driven))
+    start = time.time()
+    if batch:
+        st.create_swing_twists(pairs, twist_weight=0.5, swing_weight=0.5)
+    else:
+        for driver, driven in pairs:
+            st.create_swing_twist(driver, driven, twist_weight=0.5, swing_weight=0.5)
+    return time.time() - start
+
+
+def measure(count, frames, use_array):
+    import maya.cmds as cmds
+
+    driven = build_rig(count, use_array)
+    plugs = ["{}.worldMatrix[0]".format(j) for j in driven]
+    start = time.time()
+    for frame in range(frames):
+        cmds.currentTime(frame % 100 + 1)
+        for plug in plugs:
+            cmds.getAttr(plug)
+    return frames / (time.time() - start)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="swingTwist evaluation benchmark")
+    parser.add_argument("-c", "--count", type=int, default=500, help="Driver/driven pairs")
+    parser.add_argument("-f", "--frames", type=int, default=200, help="Frames to evaluate")
+    args = parser.parse_args()
+
+    import maya.standalone
+
+    maya.standalone.initialize()
+    import maya.cmds as cmds
+
+    cmds.loadPlugin("cmt")
+    loop_build = measure_build(args.count, False)
+    batch_build = measure_build(args.count, True)
+    print("Build {} swingTwist nodes in a loop: {:.3f}s".format(args.count, loop_build))
+    print("Build {} swingTwist nodes in one batch: {:.3f}s".format(args.count, batch_build))
+    single = measure(args.count, args.frames, False)
+    array = measure(args.count, args.frames, True)
+    print("{} swingTwist nodes: {:.1f} fps".format(args.count, single))
+    print("1 swingTwistArray node with {} pairs: {:.1f} fps".format(args.count, array))
+    maya.standalone.uninitialize()
+
+
+if __name__ == "__main__":
+    main()
@@ -1,4 +1,7 @@
+import struct
+
 import maya.cmds as cmds
+import maya.mel as mel
 import cmt.shortcuts as shortcuts
 
 
@@ -23,7 +26,15 @@ class Parts(object):
     right_foot = 17
 
 
-def create(prefix=None):
+def create(prefix=None, use_matrix_outputs=False):
+    """Create an ikRig node retargeting the source skeleton on to the prefixed target skeleton.
+
+    :param prefix: Optional prefix of the target skeleton joints.
+    :param use_matrix_outputs: True to drive the locators offsetParentMatrix from outputMatrix
+        instead of outputTranslate/outputRotate.  This skips the Euler decomposition in the node.
+        Requires Maya 2020+.
+    :return: The ikRig node.
+    """
     if prefix is None:
         prefix = ""
     node = cmds.createNode("ikRig")
@@ -47,8 +58,13 @@ def create(prefix=None):
         cmds.setAttr("{}.targetRestMatrix[{}]".format(node, i), *matrix, type="matrix")
 
         loc = cmds.spaceLocator(name="ikrig_{}".format(out_joints[i]))[0]
-        cmds.connectAttr("{}.outputTranslate[{}]".format(node, i), "{}.t".format(loc))
-        cmds.connectAttr("{}.outputRotate[{}]".format(node, i), "{}.r".format(loc))
+        if use_matrix_outputs:
+            cmds.connectAttr(
+                "{}.outputMatrix[{}]".format(node, i), "{}.offsetParentMatrix".format(loc)
+            )
+        else:
+            cmds.connectAttr("{}.outputTranslate[{}]".format(node, i), "{}.t".format(loc))
+            cmds.connectAttr("{}.outputRotate[{}]".format(node, i), "{}.r".format(loc))
 
         cmds.setAttr("{}Shape.localScale".format(loc), 5, 5, 5)
         locs.append(loc)
@@ -59,6 +75,43 @@ def create(prefix=None):
     cmds.connectAttr("{}.rootMotion".format(node), "{}.opm".format(loc))
     return node
 
+
+def export_matrix_stream(file_path, joints, rest_matrices=None, start=None, end=None):
+    """Export the world matrices of the given joints to a matrix stream file used by the offline
+    ikRetarget tool.
+
+    :param file_path: Output file path.
+    :param joints: Joints to export in ikRig part order (see Parts).
+    :param rest_matrices: Optional list of flat 16 value world matrices, one per joint, written
+        as the rest pose.  Defaults to the world matrices of the joints at the current time.
+    :param start: Start frame.  Defaults to the playback start.  If start and end are both None,
+        no animation is exported and the file only holds the rest pose.
+    :param end: End frame.  Defaults to the playback end.
+    """
+    if rest_matrices is None:
+        rest_matrices = [cmds.getAttr("{}.worldMatrix[0]".format(j)) for j in joints]
+    if len(rest_matrices) != len(joints):
+        raise RuntimeError("Need one rest matrix per joint")
+    frames = []
+    if start is not None or end is not None:
+        if start is None:
+            start = int(cmds.playbackOptions(q=True, min=True))
+        if end is None:
+            end = int(cmds.playbackOptions(q=True, max=True))
+        for frame in range(start, end + 1):
+            frames.append(
+                [cmds.getAttr("{}.worldMatrix[0]".format(j), time=frame) for j in joints]
+            )
+    frame_rate = mel.eval("currentTimeUnitToFPS")
+    with open(file_path, "wb") as fh:
+        fh.write(b"CMTM")
+        fh.write(struct.pack("<IIId", 1, len(joints), len(frames), frame_rate))
+        for matrix in rest_matrices:
+            fh.write(struct.pack("<16d", *matrix))
+        for frame in frames:
+            for matrix in frame:
+                fh.write(struct.pack("<16d", *matrix))
+
 """
 import maya.api.OpenMaya as OpenMaya
 import cmt.shortcuts as shortcuts
@@ -0,0 +1,75 @@
+"""Helpers for the demBones skinning decomposition command."""
+import array
+import struct
+import time
+
+import maya.cmds as cmds
+import maya.mel as mel
+import maya.api.OpenMaya as OpenMaya
+import cmt.shortcuts as shortcuts
+
+POINT_CACHE_VERSION = 1
+
+
+def export_point_cache(mesh, file_path, start=None, end=None):
+    """Export the world space vertex positions of a mesh to a point cache file that can be
+    passed to the demBones command with -cacheFile.
+
+    Exporting once lets demBones be run repeatedly with different settings without
+    evaluating the scene for every frame of every run.
+
+    :param mesh: Mesh transform or shape.
+    :param file_path: Output file path.
+    :param start: Start frame.  Defaults to the playback start.
+    :param end: End frame.  Defaults to the playback end.
+    """
+    if start is None:
+        start = int(cmds.playbackOptions(q=True, min=True))
+    if end is None:
+        end = int(cmds.playbackOptions(q=True, max=True))
+    path = shortcuts.get_dag_path2(shortcuts.get_shape(mesh))
+    fn_mesh = OpenMaya.MFnMesh(path)
+    frame_count = end - start + 1
+    frame_rate = mel.eval("currentTimeUnitToFPS")
+    current_time = cmds.currentTime(q=True)
+    with open(file_path, "wb") as fh:
+        fh.write(b"CMTP")
+        fh.write(
+            struct.pack(
+                "<IIIdd",
+                POINT_CACHE_VERSION,
+                fn_mesh.numVertices,
+                frame_count,
+                start,
+                frame_rate,
+            )
+        )
+        for frame in range(start, end + 1):
+            cmds.currentTime(frame, update=True)
+            points = fn_mesh.getFloatPoints(OpenMaya.MSpace.kWorld)
+            values = array.array("f", [v for p in points for v in (p.x, p.y, p.z)])
+            values.tofile(fh)
+    cmds.currentTime(current_time)
+
+
+def wait_for_job(job, timeout=None, interval=0.1):
+    """Wait for a background demBones job started with -background to stop running.
+
+    Finished jobs are committed to the scene on idle, so the returned status of a successful
+    job is either "finished" or "committed".
+
+    :param job: Job id returned by demBones -background.
+    :param timeout: Maximum number of seconds to wait.  Defaults to no limit.
+    :param interval: Number of seconds between status queries.
+    :return: The status of the job.
+    """
+    start = time.time()
+    while True:
+        if job not in (cmds.demBones(listJobs=True) or []):
+            return "committed"
+        status = cmds.demBones(jobStatus=job)
+        if status not in ("queued", "running"):
+            return status
+        if timeout is not None and time.time() - start > timeout:
+            return status
+        time.sleep(interval)
@@ -47,6 +47,18 @@ Twist forearm from wrist::
     create_swing_twist(wrist, twist_joint1, twist_weight=0.5, swing_weight=0.0)
     create_swing_twist(wrist, twist_joint2, twist_weight=1.0, swing_weight=0.0)
 
+Drive many transforms from a single swingTwistArray node::
+
+    create_swing_twist_array(
+        [(shoulder, upper_twist1), (shoulder, upper_twist2), (wrist, forearm_twist1)],
+        twist_weight=0.5,
+        swing_weight=0.0,
+    )
+
+Distribute the twist of one driver across a twist chain with a single decomposition::
+
+    create_twist_distribution(wrist, [twist_joint1, twist_joint2, twist_joint3])
+
 Use no plugins::
 
     import cmt.settings as settings
@@ -158,7 +170,154 @@ def create_swing_twist(
         "{}.matrixSum".format(mult), "{}.offsetParentMatrix".format(driven)
     )
 
-    # Zero out local xforms to prevent double xform
+    _zero_local_xforms(driven)
+
+    logger.info(
+        "Created swing twist network to drive {} from {}".format(driven, driver)
+    )
+
+
+def create_swing_twists(pairs, twist_weight=1.0, swing_weight=1.0, twist_axis=0):
+    """Create a swingTwist node for each driver/driven pair with a single command call.
+
+    All nodes are created and connected in one undo chunk which is much faster than
+    calling create_swing_twist in a loop when building hundreds of twist setups.  Setting
+    cmt.settings.ENABLE_PLUGINS to False falls back to one vanilla network per pair.
+
+    :param pairs: List of (driver, driven) tuples
+    :param twist_weight: -1 to 1 twist scalar or a list with one value per pair
+    :param swing_weight: -1 to 1 swing scalar or a list with one value per pair
+    :param twist_axis: Local twist axis on driver (0: X, 1: Y, 2: Z) or a list with one
+        value per pair
+    :return: List of the created swingTwist nodes or None if plugins are disabled
+    """
+    count = len(pairs)
+    twist_weights = _per_pair(twist_weight, count)
+    swing_weights = _per_pair(swing_weight, count)
+    twist_axes = _per_pair(twist_axis, count)
+    if not settings.ENABLE_PLUGINS:
+        for i, (driver, driven) in enumerate(pairs):
+            create_swing_twist(
+                driver, driven, twist_weights[i], swing_weights[i], twist_axes[i]
+            )
+        return None
+    cmds.loadPlugin("cmt", qt=True)
+    objects = [node for pair in pairs for node in pair]
+    nodes = cmds.swingTwist(
+        objects, twist=twist_weights, swing=swing_weights, twistAxis=twist_axes
+    )
+    if not isinstance(nodes, list):
+        nodes = [nodes]
+    return nodes
+
+
+def _per_pair(value, count):
+    """Expand a scalar argument to a list with one value per pair."""
+    if isinstance(value, (list, tuple)):
+        if len(value) != count:
+            raise RuntimeError(
+                "Expected {} values, got {}".format(count, len(value))
+            )
+        return list(value)
+    return [value] * count
+
+
+def create_swing_twist_array(pairs, twist_weight=1.0, swing_weight=1.0, twist_axis=0):
+    """Create a single swingTwistArray node driving the offsetParentMatrix of each driven
+    transform from the decomposed swing/twist of its driver.
+
+    Evaluating all pairs in one node avoids the per node overhead of hundreds of swingTwist
+    nodes.  Setting cmt.settings.ENABLE_PLUGINS to False falls back to one vanilla network
+    per pair.
+
+    :param pairs: List of (driver, driven) tuples
+    :param twist_weight: -1 to 1 twist scalar
+    :param swing_weight: -1 to 1 swing scalar
+    :param twist_axis: Local twist axis on driver (0: X, 1: Y, 2: Z)
+    :return: The swingTwistArray node or None if plugins are disabled
+    """
+    if not settings.ENABLE_PLUGINS:
+        for driver, driven in pairs:
+            create_swing_twist(driver, driven, twist_weight, swing_weight, twist_axis)
+        return None
+    cmds.loadPlugin("cmt", qt=True)
+    objects = [node for pair in pairs for node in pair]
+    return cmds.swingTwist(
+        objects,
+        array=True,
+        twist=twist_weight,
+        swing=swing_weight,
+        twistAxis=twist_axis,
+    )
+
+
+def create_twist_distribution(
+    driver, driven, twist_weight=1.0, swing_weight=0.0, twist_axis=0, weights=None
+):
+    """Create a single swingTwist node that decomposes the driver once and drives the
+    offsetParentMatrix of several transforms at different weights.
+
+    Requires the compiled plug-in.
+
+    :param driver: Driver transform
+    :param driven: List of driven transforms, ordered from least to most weight
+    :param twist_weight: -1 to 1 twist scalar applied to all outputs
+    :param swing_weight: -1 to 1 swing scalar applied to all outputs
+    :param twist_axis: Local twist axis on driver (0: X, 1: Y, 2: Z)
+    :param weights: Optional list of per driven weights.  Defaults to the node's
+        distributionFalloff curve which evenly distributes the twist down the chain.
+    :return: The swingTwist node
+    """
+    cmds.loadPlugin("cmt", qt=True)
+    node = cmds.createNode("swingTwist", name="{}_twist_distribution".format(driver))
+    cmds.connectAttr("{}.matrix".format(driver), "{}.driverMatrix".format(node))
+    cmds.setAttr(
+        "{}.driverRestMatrix".format(node), _local_matrix(driver), type="matrix"
+    )
+    cmds.setAttr("{}.twist".format(node), twist_weight)
+    cmds.setAttr("{}.swing".format(node), swing_weight)
+    cmds.setAttr("{}.twistAxis".format(node), twist_axis)
+    cmds.setAttr("{}.useDistributionFalloff".format(node), weights is None)
+    # Linear falloff so evenly spaced outputs get evenly distributed twist
+    for i, value in enumerate([0.0, 1.0]):
+        entry = "{}.distributionFalloff[{}]".format(node, i)
+        cmds.setAttr("{}.distributionFalloff_Position".format(entry), value)
+        cmds.setAttr("{}.distributionFalloff_FloatValue".format(entry), value)
+        cmds.setAttr("{}.distributionFalloff_Interp".format(entry), 1)
+    for i, transform in enumerate(driven):
+        cmds.setAttr(
+            "{}.distributionTargetRestMatrix[{}]".format(node, i),
+            _local_matrix(transform),
+            type="matrix",
+        )
+        if weights is not None:
+            cmds.setAttr("{}.distributionWeight[{}]".format(node, i), weights[i])
+        cmds.connectAttr(
+            "{}.distributionOutMatrix[{}]".format(node, i),
+            "{}.offsetParentMatrix".format(transform),
+        )
+        _zero_local_xforms(transform)
+    return node
+
+
+def _local_matrix(transform):
+    """Get the local matrix of a transform including any offsetParentMatrix.
+
+    :param transform: Transform name
+    :return: The local matrix as a list
+    """
+    pinv = OpenMaya.MMatrix(
+        cmds.getAttr("{}.parentInverseMatrix[0]".format(transform))
+    )
+    m = OpenMaya.MMatrix(cmds.getAttr("{}.worldMatrix[0]".format(transform)))
+    return list(m * pinv)
+
+
+def _zero_local_xforms(driven):
+    """Zero out local xforms to prevent double xform.
+
+    :param driven: Transform driven through its offsetParentMatrix
+    """
     for attr in ["{}{}".format(x, y) for x in ["t", "r", "jo"] for y in "xyz"]:
         is_locked = cmds.getAttr("{}.{}".format(driven, attr), lock=True)
         if is_locked:
@@ -167,10 +326,6 @@ def create_swing_twist(
         if is_locked:
             cmds.setAttr("{}.{}".format(driven, attr), lock=True)
 
-    logger.info(
-        "Created swing twist network to drive {} from {}".format(driven, driver)
-    )
-
 
 def _twist_network_exists(driver):
     """Test whether the twist decomposition network already exists on driver.
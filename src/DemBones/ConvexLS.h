@@ -25,14 +25,16 @@ namespace Dem
 	@f}
 	The solver implements active set method to handle non-negativity constraint and QR decomposition to handle affinity constraint.
 
-	@b _Scalar is the floating-point data type.
+	@b _Scalar is the floating-point data type. @b _MaxSize is the compile time bound of the size of @f$ x @f$, with a fixed bound
+	all matrices, vectors and decompositions of solve() live on the stack and never call the allocator.
 */
-template<class _Scalar>
+template<class _Scalar, int _MaxSize=Eigen::Dynamic>
 class ConvexLS {
 public:
 	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
-	using MatrixX=Eigen::Matrix<_Scalar, Eigen::Dynamic, Eigen::Dynamic>;
-	using VectorX=Eigen::Matrix<_Scalar, Eigen::Dynamic, 1>;
+	using MatrixX=Eigen::Matrix<_Scalar, Eigen::Dynamic, Eigen::Dynamic, 0, _MaxSize, _MaxSize>;
+	using VectorX=Eigen::Matrix<_Scalar, Eigen::Dynamic, 1, 0, _MaxSize, 1>;
+	using ArrayXi=Eigen::Array<int, Eigen::Dynamic, 1, 0, _MaxSize, 1>;
 
 	/** Constructor, just call init()
 		@param[in] maxSize is the maximum size of the unknown @f$ x @f$ if the affinity constraint is imposed.
@@ -67,7 +69,7 @@ public:
 
 		if (!warmStart) x=VectorX::Constant(n, _Scalar(1)/n);
 
-		Eigen::ArrayXi idx(n);
+		ArrayXi idx(n);
 		int np=0;
 		for (int i=0; i<n; i++)
 			if (x(i)>0) idx[np++]=i; else idx[n-i+np-1]=i;
@@ -85,7 +87,7 @@ public:
 				std::swap(idx[iMax+np], idx[np]);
 				np++;
 			} else {
-				_Scalar alpha;
+				_Scalar alpha=0;
 				int iMin=-1;
 				for (int i=0; i<np; i++)
 					if (p(idx[i])<0) {
@@ -117,7 +119,7 @@ private:
 		@param[in] zeroSum=true will impose zer-sum of gradient
 		@param[output] p is the by-reference negative gradient output
 	*/
-	void solveP(const MatrixX& aTa, const VectorX& aTb, const VectorX& x, const Eigen::ArrayXi& idx, int np, bool zeroSum, VectorX& p) {
+	void solveP(const MatrixX& aTa, const VectorX& aTb, const VectorX& x, const ArrayXi& idx, int np, bool zeroSum, VectorX& p) {
 		VectorX z;
 		p.setZero(aTb.size());
 		if (!zeroSum) {
@@ -12,7 +12,11 @@
 #include <Eigen/Sparse>
 #include <Eigen/StdVector>
 #include <algorithm>
-#include <queue>
+#include <iostream>
+#include <random>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include "ConvexLS.h"
 
 #ifndef DEM_BONES_MAT_BLOCKS
@@ -39,7 +43,7 @@ namespace Dem
 		- Bone transformations: DemBones::m
 	-# [@c optional] Set parameters in the base class: 
 		- DemBones::nIters
-		- DemBones::nInitIters
+		- DemBones::nInitIters, DemBones::initMethod
 		- DemBones::nTransIters, DemBones::transAffine, DemBones::transAffineNorm
 		- DemBones::nWeightsIters, DemBones::nnz, DemBones::weightsSmooth, DemBones::weightsSmoothStep, DemBones::weightEps
 	-# [@c optional] Setup extended class:
@@ -74,12 +78,19 @@ public:
 	using Vector3=Eigen::Matrix<_Scalar, 3, 1>;
 	using SparseMatrix=Eigen::SparseMatrix<_Scalar>;
 	using Triplet=Eigen::Triplet<_Scalar>;
+	using MatrixXAniMesh=Eigen::Matrix<_AniMeshScalar, Eigen::Dynamic, Eigen::Dynamic>;
 
 	//! [@c parameter] Number of global iterations, @c default = 30
 	int nIters;
 
 	//! [@c parameter] Number of clustering update iterations in the initalization, @c default = 10
 	int nInitIters;
+
+	/** [@c parameter] Bone clustering of init() when both #w and #m are missing, @c default = 0
+		@details 0 splits the bone clusters repeatedly (LBG-VQ) and re-labels the whole mesh between splits. 1 clusters projected
+		vertex trajectories directly in to #nB bones with k-means++ and fits the bone transformations once, see initKMeans().
+	*/
+	int initMethod;
 	
 	//! [@c parameter] Number of bone transformations update iterations per global iteration, @c default = 5
 	int nTransIters;
@@ -98,16 +109,49 @@ public:
 	_Scalar weightsSmoothStep;
 	//! [@c parameter] Epsilon for weights solver, @c default = 1e-15
 	_Scalar weightEps;
+
+	/** [@c parameter] Number of frames processed together by the frame parallel kernels reading #v, @c default = 0 (all frames)
+		@details Set this when #v is mapped to a file with mapV() so compute_vuT() and computeTransFromLabel() only touch the
+		pages of one block of frames at a time instead of all frames at once. The vertex parallel kernels (rmse(), compute_aTb(),
+		errorVtxBone()) already stream through #v one vertex column at a time. Blocking adds a thread synchronization per block
+		and the mapped pages are re-read from disk by every kernel that visits them, so expect a slowdown over in-memory storage
+		that depends on the disk and page cache rather than on this value.
+	*/
+	int nFrameBlock;
+
+	/** [@c parameter] Number of extra candidate bones per vertex in the weights update, @c default = 0
+		@details Each vertex solves its weights over the #nnz bones with the largest smoothed weights. A positive value adds up
+		to this many bones that neighbour the current bones of the vertex on the mesh, so a bone outside the smoothed support can
+		take over. The #nnz largest weights of the candidates are then solved again.
+	*/
+	int nCandidates;
+
+	//! [@c parameter] Index of the first global iteration of compute(), set when continuing a previous solve, @c default = 0
+	int iterStart;
+
+	/** [@c parameter] Solve the weights smoothing with preconditioned conjugate gradients instead of a sparse LU factorization, @c default = false
+		@details The LU fill-in of large meshes takes gigabytes and minutes to factor. The iterative solve only stores the Laplacian and
+		its incomplete Cholesky factor, each bone keeps a few vectors of #nV values while it is solved, and the solves start from the
+		smoothed weights of the previous weights iteration.
+	*/
+	bool iterativeSmooth;
+	//! [@c parameter] Relative residual of the iterative weights smoothing solve, @c default = 1e-8
+	_Scalar smoothTolerance;
 	
 	/** @brief Constructor and setting default parameters
 	*/
-	DemBones():	nIters(30), nInitIters(10), 
+	DemBones():	nIters(30), nInitIters(10), initMethod(0), 
 			nTransIters(5),	transAffine(_Scalar(10)), transAffineNorm(_Scalar(4)),
 			nWeightsIters(3), nnz(8), weightsSmooth(_Scalar(1e-4)), weightsSmoothStep(_Scalar(1)),
-			weightEps(_Scalar(1e-15)),
+			weightEps(_Scalar(1e-15)), nFrameBlock(0), nCandidates(0), iterStart(0), iterativeSmooth(false),
+			smoothTolerance(_Scalar(1e-8)), v(nullptr, 0, 0),
 			iter(_iter), iterTransformations(_iterTransformations), iterWeights(_iterWeights) {
 		clear();
 	}
+
+	//! #v may map #vStorage of this object, a copy would keep pointing at the storage of the source
+	DemBones(const DemBones&)=delete;
+	DemBones& operator=(const DemBones&)=delete;
 	
 	//! Number of vertices, typically indexed by @p i
 	int nV;
@@ -134,9 +178,33 @@ public:
 	*/
 	MatrixX m;
 	MatrixX origM;
+
+	//! Bone cluster of each vertex from the initialization, @c size = #nV, #label(@p i) is the index of the bone associated with vertex @p i
+	Eigen::VectorXi label;
 	
-	//! Animated mesh sequence, @c size = [3*#nF, #nV], #v.@a col(@p i).@a segment(3*@p k, 3) is the position of vertex @p i at frame @p k
-	Eigen::Matrix<_AniMeshScalar, Eigen::Dynamic, Eigen::Dynamic> v;
+	/** @brief Animated mesh sequence, @c size = [3*#nF, #nV], #v.@a col(@p i).@a segment(3*@p k, 3) is the position of vertex @p i at frame @p k
+		@details Allocate with resizeV() or point at external storage such as a memory mapped file with mapV().
+	*/
+	Eigen::Map<MatrixXAniMesh> v;
+
+	/** @brief Allocate #v in memory owned by the class
+		@param rows is the number of rows, 3*#nF
+		@param cols is the number of columns, #nV
+	*/
+	void resizeV(int rows, int cols) {
+		vStorage.resize(rows, cols);
+		new (&v) Eigen::Map<MatrixXAniMesh>(vStorage.data(), rows, cols);
+	}
+
+	/** @brief Use external column major storage for #v, the storage must outlive any use of #v
+		@param data is the storage of at least @p rows*@p cols values
+		@param rows is the number of rows, 3*#nF
+		@param cols is the number of columns, #nV
+	*/
+	void mapV(_AniMeshScalar* data, int rows, int cols) {
+		vStorage.resize(0, 0);
+		new (&v) Eigen::Map<MatrixXAniMesh>(data, rows, cols);
+	}
 	
 	//! Mesh topology, @c size=[<tt>number of polygons</tt>], #fv[@p p] is the vector of vertex indices of polygon @p p
 	std::vector<std::vector<int>> fv;
@@ -159,10 +227,13 @@ public:
 		u.resize(0, 0);
 		w.resize(0, 0);
 		m.resize(0, 0);
-		v.resize(0, 0);
+		mapV(nullptr, 0, 0);
 		fv.resize(0);
 		modelSize=-1;
 		laplacian.resize(0, 0);
+		smoothMatrix.resize(0, 0);
+		smoothBuiltIterative=smoothConjugateGradient=false;
+		ws.resize(0, 0);
 	}
 
 	/** @brief Initialize missing skinning weights and/or bone transformations
@@ -170,7 +241,7 @@ public:
 			- Both #w and #m are already set: do nothing
 			- Only one in #w or #m is missing (zero size): initialize missing matrix, i.e. #w (or #m)
 			- Both #w and #m are missing (zero size): initialize both with rigid skinning using approximately #nB bones, i.e. values of #w are 0 or 1.
-			LBG-VQ clustering is peformed using mesh sequence #v, rest pose geometries #u and topology #fv.
+			LBG-VQ clustering (or k-means++, see #initMethod) is peformed using mesh sequence #v, rest pose geometries #u and topology #fv.
 			@b Note: as the initialization does not use exactly #nB bones, the value of #nB could be changed when both #w and #m are missing.
 			
 		This function is called at the begining of every compute update functions as a safeguard.
@@ -182,27 +253,30 @@ public:
 		if (((int)w.rows()!=nB)||((int)w.cols()!=nV)) { //No skinning weight
 			if (((int)m.rows()!=nF*4)||((int)m.cols()!=nB*4)) { //No transformation
 				int targetNB=nB;
-				//LBG-VQ
-				nB=m.cols() == 0 ? 1 : (int)m.cols() / 4;
-				label=Eigen::VectorXi::Zero(nV);
-				computeTransFromLabel();
-        auto prevNB = nB;
-				bool cont=true;
-				while (cont) {
-					cbInitSplitBegin();
-					split(targetNB, nnz);
-					cont=(nB<targetNB);
-					for (int rep=0; rep<nInitIters; rep++) {
-						computeTransFromLabel();
-						computeLabel();
-						pruneBones(nnz);
-					}
-					cbInitSplitEnd();
-					if (prevNB == nB) {
-						std::cout << "Unable to initialize bone transforms." << std::endl;
-						return false;
+				if (initMethod==1) initKMeans();
+				else {
+					//LBG-VQ
+					nB=m.cols() == 0 ? 1 : (int)m.cols() / 4;
+					label=Eigen::VectorXi::Zero(nV);
+					computeTransFromLabel();
+					auto prevNB = nB;
+					bool cont=true;
+					while (cont) {
+						cbInitSplitBegin();
+						split(targetNB, nnz);
+						cont=(nB<targetNB);
+						for (int rep=0; rep<nInitIters; rep++) {
+							computeTransFromLabel();
+							computeLabel();
+							pruneBones(nnz);
+						}
+						cbInitSplitEnd();
+						if (prevNB == nB) {
+							std::cout << "Unable to initialize bone transforms." << std::endl;
+							return false;
+						}
+						prevNB = nB;
 					}
-					prevNB = nB;
 				}
 				m.conservativeResize(nF*4, nB*4);
 				if (origM.rows() && m.cols() >= origM.cols()) {
@@ -254,7 +328,7 @@ public:
 			if (origM.rows() && m.cols() >= origM.cols()) {
 				m.block(0, 0, origM.rows(), origM.cols()) = origM;
 			}
-			cbTransformationsIterEnd();
+			if (cbTransformationsIterEnd()) break;
 		}
 		
 		cbTransformationsEnd();
@@ -282,47 +356,34 @@ public:
 		compute_mTm();
 
 		aTb=MatrixX::Zero(nB, nV);
-		wSolver.init(nnz);
+		int maxCandidates=std::min(nnz+std::max(nCandidates, 0), nB);
+		if (maxCandidates<=8) wSolverFixed.init(maxCandidates); else wSolver.init(maxCandidates);
+		//Each vertex writes its weights to its own preallocated slots so the merge order does not depend on the threads
+		int nSlots=std::min(nnz, nB);
+		std::vector<Triplet, Eigen::aligned_allocator<Triplet>> slots(nV*nSlots);
+		std::vector<int> slotCount(nV);
 		std::vector<Triplet, Eigen::aligned_allocator<Triplet>> trip;
-		trip.reserve(nV*nnz);
+		trip.reserve(nV*nSlots);
+		std::vector<std::vector<int>> boneAdjacency;
+		if (nCandidates>0) computeBoneAdjacency(boneAdjacency);
 
 		for (_iterWeights=0; _iterWeights<nWeightsIters; _iterWeights++) {
 			cbWeightsIterBegin();
 
 			compute_ws();
-			compute_aTb();
 
-			double reg=pow(modelSize, 2)*nF*weightsSmooth;
+			_Scalar reg=pow(modelSize, 2)*nF*weightsSmooth;
+			if (maxCandidates<=8) solveWeights(wSolverFixed, reg, boneAdjacency, maxCandidates, slots, slotCount);
+			else solveWeights(wSolver, reg, boneAdjacency, maxCandidates, slots, slotCount);
 
 			trip.clear();
-			#pragma omp parallel for
-			for (int i=0; i<nV; i++) {
-				MatrixX aTai;
-				compute_aTa(i, aTai);
-				aTai+=reg*MatrixX::Identity(nB, nB);
-				VectorX aTbi=aTb.col(i)+reg*ws.col(i);
-
-				VectorX x=ws.col(i);
-				Eigen::ArrayXi idx=Eigen::ArrayXi::LinSpaced(nB, 0, nB-1);
-				std::sort(idx.data(), idx.data()+nB, [&x](int i1, int i2) { return x(i1)>x(i2); });
-				int nnzi=std::min(nnz, nB);
-				while (x(idx(nnzi-1))<weightEps) nnzi--;
-
-				x=indexing_vector(w.col(i).toDense().cwiseMax(0.0), idx.head(nnzi));
-				_Scalar s=x.sum();
-				if (s>_Scalar(0.1)) x/=s; else x=VectorX::Constant(nnzi, _Scalar(1)/nnzi);
-
-				wSolver.solve(indexing_row_col(aTai, idx.head(nnzi), idx.head(nnzi)), indexing_vector(aTbi, idx.head(nnzi)), x, true, true);
-
-				#pragma omp critical
-				for (int j=0; j<nnzi; j++)
-					if (x(j)!=0) trip.push_back(Triplet(idx[j], i, x(j)));
-			}
+			for (int i=0; i<nV; i++)
+				trip.insert(trip.end(), slots.begin()+i*nSlots, slots.begin()+i*nSlots+slotCount[i]);
 
 			w.resize(nB, nV);
 			w.setFromTriplets(trip.begin(), trip.end());
 			
-			cbWeightsIterEnd();
+			if (cbWeightsIterEnd()) break;
 		}
 		
 		cbWeightsEnd();
@@ -345,14 +406,293 @@ public:
 			return false;
 		}
 
-		for (_iter=0; _iter<nIters; _iter++) {
+		for (_iter=iterStart; _iter<nIters; _iter++) {
+			cbIterBegin();
+			computeTranformations();
+			computeWeights();
+			if (cbIterEnd()) break;
+		}
+		return true;
+	}
+	
+	/** @brief Coarse-to-fine skinning decomposition
+		@details Runs compute() on about @p ratio*#nV seed vertices chosen by decimate(), gives every vertex the weights of the seed of
+		its patch, then runs @p nRefineIters global iterations on the full mesh. The coarse solve scales the per-vertex kernels
+		(computeWeights(), compute_vuT(), computeLabel()) down by @p ratio, the refinement only has to correct the prolongated weights.
+		#iter keeps counting through the refinement iterations. cbRefineBegin() can skip the refinement.
+		@param ratio is the fraction of vertices kept by the coarse solve, values >= 1 run compute()
+		@param nRefineIters is the number of global iterations at full resolution
+		@return false if the initialization failed
+	*/
+	bool computeMultiRes(double ratio, int nRefineIters) {
+		if (ratio>=1) return compute();
+		if (modelSize<0) modelSize=sqrt((u-(u.rowwise().sum()/nV).replicate(1, nV)).squaredNorm()/nV/nS);
+
+		std::vector<int> seed;
+		Eigen::VectorXi patch;
+		decimate(ratio, seed, patch);
+		int nC=(int)seed.size();
+
+		//Coarse edges between neighbouring patches, as two vertex polygons so computeSmoothSolver() can use them
+		std::vector<std::pair<int, int>> edge;
+		for (const std::vector<int>& poly: fv) {
+			int nf=(int)poly.size();
+			for (int g=0; g<nf; g++) {
+				int a=patch(poly[g]), b=patch(poly[(g+1)%nf]);
+				if (a!=b) edge.push_back(std::make_pair(std::min(a, b), std::max(a, b)));
+			}
+		}
+		std::sort(edge.begin(), edge.end());
+		edge.erase(std::unique(edge.begin(), edge.end()), edge.end());
+		std::vector<std::vector<int>> coarseFv(edge.size());
+		for (size_t e=0; e<edge.size(); e++) coarseFv[e]={edge[e].first, edge[e].second};
+
+		//Swap the full resolution data out, an owned #v keeps its buffer inside fullStorage
+		int fullNV=nV;
+		_AniMeshScalar* fullData=v.data();
+		int vRows=(int)v.rows();
+		MatrixXAniMesh fullStorage;
+		fullStorage.swap(vStorage);
+		Eigen::Map<MatrixXAniMesh> fullV(fullData, vRows, fullNV);
+		MatrixX fullU;
+		fullU.swap(u);
+		std::vector<std::vector<int>> fullFv;
+		fullFv.swap(fv);
+
+		nV=nC;
+		resizeV(vRows, nC);
+		u.resize(fullU.rows(), nC);
+		for (int c=0; c<nC; c++) {
+			v.col(c)=fullV.col(seed[c]);
+			u.col(c)=fullU.col(seed[c]);
+		}
+		fv.swap(coarseFv);
+		if (w.cols()==fullNV) {
+			std::vector<Triplet, Eigen::aligned_allocator<Triplet>> trip;
+			for (int c=0; c<nC; c++)
+				for (typename SparseMatrix::InnerIterator it(w, seed[c]); it; ++it) trip.push_back(Triplet((int)it.row(), c, it.value()));
+			w.resize(nB, nC);
+			w.setFromTriplets(trip.begin(), trip.end());
+		}
+		laplacian.resize(0, 0);
+
+		bool success=compute();
+
+		//Restore the full resolution data
+		int first=std::min(_iter+1, nIters);
+		nV=fullNV;
+		vStorage.swap(fullStorage);
+		new (&v) Eigen::Map<MatrixXAniMesh>(fullData, vRows, fullNV);
+		u.swap(fullU);
+		fv.swap(fullFv);
+		laplacian.resize(0, 0);
+		if (!success) return false;
+
+		//Prolongate the weights of each seed to its patch
+		std::vector<Triplet, Eigen::aligned_allocator<Triplet>> trip;
+		trip.reserve(w.nonZeros()*fullNV/std::max(nC, 1));
+		for (int i=0; i<nV; i++)
+			for (typename SparseMatrix::InnerIterator it(w, patch(i)); it; ++it) trip.push_back(Triplet((int)it.row(), i, it.value()));
+		w.resize(nB, nV);
+		w.setFromTriplets(trip.begin(), trip.end());
+
+		//The prolongated weights are a complete result, a stopped coarse solve keeps them as they are
+		if (!cbRefineBegin()) return true;
+		if (!init()) return false;
+		for (_iter=first; _iter<first+nRefineIters; _iter++) {
 			cbIterBegin();
 			computeTranformations();
 			computeWeights();
-			cbIterEnd();
+			if (cbIterEnd()) break;
+		}
+		return true;
+	}
+
+	/** @brief Skinning decomposition on a representative subset of the frames
+		@details Runs computeMultiRes() on about @p budget frames chosen by selectFrames(), then fits the bone transformations of all the
+		frames to the solved weights with one computeTranformations() pass. Each frame starts from the transformations of its nearest
+		chosen frame. The per-frame kernels of the solve scale down by @p budget/#nF. #iter counts the final pass as one more global iteration.
+		@param budget is the number of frames solved, the first frame of every subject is always solved, values <= 0 or >= #nF solve all frames
+		@param ratio is the fraction of vertices kept by computeMultiRes()
+		@param nRefineIters is the number of full resolution iterations of computeMultiRes()
+		@return false if the initialization failed
+	*/
+	bool computeFrameBudget(int budget, double ratio=1, int nRefineIters=0) {
+		if ((budget<=0)||(budget>=nF)) return computeMultiRes(ratio, nRefineIters);
+
+		std::vector<int> frame;
+		Eigen::VectorXi nearest;
+		selectFrames(budget, frame, nearest);
+		int nK=(int)frame.size();
+		Eigen::VectorXi pos=Eigen::VectorXi::Constant(nF, -1);
+		for (int c=0; c<nK; c++) pos(frame[c])=c;
+
+		//Swap the full sequence out, an owned #v keeps its buffer inside fullStorage
+		int fullNF=nF;
+		_AniMeshScalar* fullData=v.data();
+		MatrixXAniMesh fullStorage;
+		fullStorage.swap(vStorage);
+		Eigen::Map<MatrixXAniMesh> fullV(fullData, fullNF*3, nV);
+		Eigen::VectorXi fullFStart=fStart, fullSubjectID=subjectID;
+		MatrixX fullM, fullOrigM;
+		fullM.swap(m);
+		fullOrigM.swap(origM);
+
+		nF=nK;
+		resizeV(nK*3, nV);
+		#pragma omp parallel for
+		for (int i=0; i<nV; i++)
+			for (int c=0; c<nK; c++) v.col(i).template segment<3>(c*3)=fullV.col(i).template segment<3>(frame[c]*3);
+		subjectID.resize(nK);
+		fStart.setZero();
+		for (int c=0; c<nK; c++) {
+			subjectID(c)=fullSubjectID(frame[c]);
+			fStart(subjectID(c)+1)=c+1;
+		}
+		for (int s=0; s<nS; s++) fStart(s+1)=std::max(fStart(s+1), fStart(s));
+		if (fullM.rows()==fullNF*4) {
+			m.resize(nK*4, fullM.cols());
+			for (int c=0; c<nK; c++) m.middleRows(c*4, 4)=fullM.middleRows(frame[c]*4, 4);
+		}
+		if (fullOrigM.rows()==fullNF*4) {
+			origM.resize(nK*4, fullOrigM.cols());
+			for (int c=0; c<nK; c++) origM.middleRows(c*4, 4)=fullOrigM.middleRows(frame[c]*4, 4);
+		}
+		laplacian.resize(0, 0);
+
+		bool success=computeMultiRes(ratio, nRefineIters);
+
+		//Restore the full sequence
+		int last=std::min(_iter+1, nIters+((ratio<1)?nRefineIters:0));
+		nF=fullNF;
+		vStorage.swap(fullStorage);
+		new (&v) Eigen::Map<MatrixXAniMesh>(fullData, fullNF*3, nV);
+		fStart=fullFStart;
+		subjectID=fullSubjectID;
+		origM.swap(fullOrigM);
+		laplacian.resize(0, 0);
+		if (!success) {
+			m.swap(fullM);
+			return false;
+		}
+
+		//Fit every frame starting from its nearest solved frame
+		MatrixX solvedM;
+		solvedM.swap(m);
+		m.resize(nF*4, solvedM.cols());
+		for (int k=0; k<nF; k++) m.middleRows(k*4, 4)=solvedM.middleRows(pos(nearest(k))*4, 4);
+		if (origM.rows() && m.cols() >= origM.cols()) {
+			m.block(0, 0, origM.rows(), origM.cols()) = origM;
 		}
+		_iter=last;
+		cbIterBegin();
+		computeTranformations();
+		cbIterEnd();
 		return true;
 	}
+
+	/** @brief Picks representative frames by farthest-point sampling of the per-frame vertex displacements
+		@details The first frame of every subject seeds the sampling, then the frame farthest from all the picked ones is added until @p budget
+		frames are picked or the remaining frames duplicate picked ones. Displacements from the rest shapes #u are compared on at most 1024 evenly
+		spaced vertices.
+		@param budget is the number of frames to pick
+		@param frame is the output list of picked frames in increasing order
+		@param nearest is the output picked frame closest to every frame, @c size = #nF
+	*/
+	void selectFrames(int budget, std::vector<int>& frame, Eigen::VectorXi& nearest) const {
+		int nP=std::min(nV, 1024);
+		MatrixX d(nP*3, nF);
+		#pragma omp parallel for
+		for (int p=0; p<nP; p++) {
+			int i=(int)((long long)p*nV/nP);
+			for (int k=0; k<nF; k++)
+				d.col(k).template segment<3>(p*3)=v.col(i).template segment<3>(k*3).template cast<_Scalar>()-u.col(i).template segment<3>(subjectID(k)*3);
+		}
+
+		VectorX dist(nF);
+		nearest=Eigen::VectorXi::Constant(nF, -1);
+		std::vector<char> picked(nF, 0);
+		int nK=0;
+		auto pick=[&](int c) {
+			picked[c]=1;
+			nK++;
+			#pragma omp parallel for
+			for (int k=0; k<nF; k++) {
+				_Scalar e=(d.col(k)-d.col(c)).squaredNorm();
+				if ((nearest(k)==-1)||(e<dist(k))) {
+					dist(k)=e;
+					nearest(k)=c;
+				}
+			}
+		};
+		for (int s=0; s<nS; s++)
+			if (fStart(s)<fStart(s+1)) pick(fStart(s));
+		int c;
+		while ((nK<budget)&&(dist.maxCoeff(&c)>0)) pick(c);
+
+		frame.clear();
+		for (int k=0; k<nF; k++)
+			if (picked[k]) frame.push_back(k);
+	}
+
+	/** @brief Splits the mesh into patches of about 1/@p ratio connected vertices for a coarse solve
+		@param ratio is the target fraction of vertices kept
+		@param seed is the output list of seed vertices, the vertex closest to the centroid of each patch
+		@param patch is the output patch index of every vertex, @c size = #nV
+	*/
+	void decimate(double ratio, std::vector<int>& seed, Eigen::VectorXi& patch) const {
+		int patchSize=std::max(1, (int)std::lround(1.0/std::max(ratio, 1e-6)));
+
+		//Vertex adjacency in compressed row form
+		std::vector<int> offset(nV+1, 0);
+		for (const std::vector<int>& poly: fv)
+			for (int i: poly) offset[i+1]+=2;
+		for (int i=0; i<nV; i++) offset[i+1]+=offset[i];
+		std::vector<int> adjacent(offset[nV]);
+		std::vector<int> fill(offset.begin(), offset.end()-1);
+		for (const std::vector<int>& poly: fv) {
+			int nf=(int)poly.size();
+			for (int g=0; g<nf; g++) {
+				int i=poly[g], j=poly[(g+1)%nf];
+				adjacent[fill[i]++]=j;
+				adjacent[fill[j]++]=i;
+			}
+		}
+
+		//Breadth first growth from the lowest unassigned vertex keeps patches compact and the result deterministic
+		seed.clear();
+		patch=Eigen::VectorXi::Constant(nV, -1);
+		std::vector<int> front;
+		for (int i=0; i<nV; i++) {
+			if (patch(i)!=-1) continue;
+			int c=(int)seed.size();
+			seed.push_back(i);
+			patch(i)=c;
+			int size=1;
+			front.assign(1, i);
+			for (size_t f=0; (f<front.size())&&(size<patchSize); f++)
+				for (int a=offset[front[f]]; (a<offset[front[f]+1])&&(size<patchSize); a++) {
+					int j=adjacent[a];
+					if (patch(j)!=-1) continue;
+					patch(j)=c;
+					front.push_back(j);
+					size++;
+				}
+
+			//The patch vertex closest to the patch centroid represents the patch
+			VectorX center=VectorX::Zero(u.rows());
+			for (int j: front) center+=u.col(j);
+			center/=(_Scalar)front.size();
+			_Scalar dMin=-1;
+			for (int j: front) {
+				_Scalar d=(u.col(j)-center).squaredNorm();
+				if ((dMin<0)||(d<dMin)) {
+					dMin=d;
+					seed[c]=j;
+				}
+			}
+		}
+	}
 	
 	//! @return Root mean squared reconstruction error
 	_Scalar rmse() {
@@ -379,8 +719,10 @@ public:
 
 	//! Callback function invoked before each global iteration update
 	virtual void cbIterBegin() {}
-	//! Callback function invoked after each global iteration update
-	virtual void cbIterEnd() {}
+	//! Callback function invoked after each global iteration update, return true to stop the solve early, e.g. when converged or cancelled
+	virtual bool cbIterEnd() { return false; }
+	//! Callback function invoked between the coarse solve and the refinement of computeMultiRes(), return false to skip the refinement, e.g. when cancelled
+	virtual bool cbRefineBegin() { return true; }
 
 	//! Callback function invoked before each skinning weights update
 	virtual void cbWeightsBegin() {}
@@ -394,17 +736,25 @@ public:
 
 	//! Callback function invoked before each local bone transformations update iteration
 	virtual void cbTransformationsIterBegin() {}
-	//! Callback function invoked after each local bone transformations update iteration
-	virtual void cbTransformationsIterEnd() {}
+	//! Callback function invoked after each local bone transformations update iteration, return true to skip the remaining iterations
+	virtual bool cbTransformationsIterEnd() { return false; }
 
 	//! Callback function invoked before each local weights update iteration
 	virtual void cbWeightsIterBegin() {}
-	//! Callback function invoked after each local weights update iteration
-	virtual void cbWeightsIterEnd() {}
+	//! Callback function invoked after each local weights update iteration, return true to skip the remaining iterations
+	virtual bool cbWeightsIterEnd() { return false; }
 
-private:
+protected:
 	int _iter, _iterTransformations, _iterWeights;
 
+	//! Storage of #v when it is allocated with resizeV()
+	MatrixXAniMesh vStorage;
+
+	//! @return Number of frames per block for the frame parallel kernels
+	int frameBlockSize() const {
+		return (nFrameBlock>0)?nFrameBlock:std::max(nF, 1);
+	}
+
 	/** Best rigid transformation from covariance matrix
 		@param _qpT is the 4*4 covariance matrix
 		@param k is the frame number
@@ -425,26 +775,23 @@ private:
 		@param i is the vertex index
 		@param j is the bone index
 	*/
-	_Scalar errorVtxBone(int i, int j, bool par=true) {
+	_Scalar errorVtxBone(int i, int j) {
 		_Scalar e=0;
-		#pragma omp parallel for if(par)
-		for (int k=0; k<nF; k++)
-			#pragma omp atomic
-			e+=(m.rotMat(k, j)*u.vec3(subjectID(k), i)+m.transVec(k, j)-v.vec3(k, i).template cast<_Scalar>()).squaredNorm();
+		for (int s=0; s<nS; s++) {
+			Vector4 _u=u.vec3(s, i).homogeneous();
+			for (int k=fStart(s); k<fStart(s+1); k++) {
+				Vector3 d=m.blk4(k, j).template topRows<3>()*_u-v.vec3(k, i).template cast<_Scalar>();
+				e+=d.squaredNorm();
+			}
+		}
 		return e;
 	}
 
-	//! label(i) is the index of the bone associated with vertex i
-	Eigen::VectorXi label;
-
-	//! Comparator for heap with smallest values on top
-	struct TripletLess {
-		bool operator() (const Triplet& t1, const Triplet& t2) {
-			return t1.value()>t2.value();
-		}
-	};
-
 	/** Update labels of vertices
+		@details Grows a region from the vertex with the smallest error of each bone. The growth runs in rounds like delta-stepping: each
+		round labels every frontier vertex whose best error is within 5% of the mean error of the current labels from the smallest
+		frontier error, then the unlabeled neighbours of the new vertices pull their candidate bones from their labeled neighbours in
+		parallel. Errors are computed once per vertex and bone.
 	*/
 	void computeLabel() {
 		VectorX ei(nV);
@@ -454,7 +801,7 @@ private:
 		for (int i=0; i<nV; i++) {
 			int j=label(i);
 			if (j!=-1) {
-				ei(i)=errorVtxBone(i, j, false);
+				ei(i)=errorVtxBone(i, j);
 				if ((seed(j)==-1)||(ei(i)<gMin(j))) {
 					#pragma omp critical
 					if ((seed(j)==-1)||(ei(i)<gMin(j))) {
@@ -465,37 +812,97 @@ private:
 			}
 		}
 
-		std::priority_queue<Triplet, std::vector<Triplet, Eigen::aligned_allocator<Triplet>>, TripletLess> heap;
-		for (int j=0; j<nB; j++) if (seed(j)!=-1) heap.push(Triplet(j, seed(j), ei(seed(j))));
-
 		if (laplacian.cols()!=nV) computeSmoothSolver();
 
-		std::vector<bool> dirty(nV, true);
-		while (!heap.empty()) {
-			Triplet top=heap.top();
-			heap.pop();
-			int i=(int)top.col();
-			int j=(int)top.row();
-			if (dirty[i]) {
-				label(i)=j;
-				ei(i)=top.value();
-				dirty[i]=false;
+		//Cached (bone, error) pairs of each vertex, starting with the error of its current label
+		std::vector<std::vector<std::pair<int, _Scalar>>> cache(nV);
+		_Scalar step=0;
+		int nLabeled=0;
+		for (int i=0; i<nV; i++)
+			if (label(i)!=-1) {
+				cache[i].push_back(std::make_pair((int)label(i), ei(i)));
+				step+=ei(i);
+				nLabeled++;
+			}
+		if (nLabeled>0) step*=_Scalar(0.05)/nLabeled;
+
+		enum { Untouched, Frontier, Labeled };
+		std::vector<char> state(nV, Untouched);
+		std::vector<int> stamp(nV, -1);
+		Eigen::VectorXi newLabel=Eigen::VectorXi::Constant(nV, -1);
+		Eigen::VectorXi bestBone=Eigen::VectorXi::Constant(nV, -1);
+		VectorX best(nV);
+
+		std::vector<int> added, touched, frontier;
+		for (int j=0; j<nB; j++)
+			if (seed(j)!=-1) {
+				newLabel(seed(j))=j;
+				state[seed(j)]=Labeled;
+				added.push_back(seed(j));
+			}
+
+		for (int round=0; !added.empty(); round++) {
+			touched.clear();
+			for (int i : added)
 				for (typename SparseMatrix::InnerIterator it(laplacian, i); it; ++it) {
 					int i2=(int)it.row();
-					if (dirty[i2]) {
-						double tmp=(label(i2)==j)?ei(i2):errorVtxBone(i2, j);
-						heap.push(Triplet(j, i2, tmp));
+					if ((state[i2]!=Labeled)&&(stamp[i2]!=round)) {
+						stamp[i2]=round;
+						touched.push_back(i2);
+					}
+				}
+
+			#pragma omp parallel for schedule(dynamic, 64)
+			for (int t=0; t<(int)touched.size(); t++) {
+				int i2=touched[t];
+				for (typename SparseMatrix::InnerIterator it(laplacian, i2); it; ++it) {
+					if (state[it.row()]!=Labeled) continue;
+					int j=newLabel(it.row());
+					_Scalar e=0;
+					bool cached=false;
+					for (const auto& c : cache[i2])
+						if (c.first==j) {
+							e=c.second;
+							cached=true;
+						}
+					if (!cached) {
+						e=errorVtxBone(i2, j);
+						cache[i2].push_back(std::make_pair(j, e));
+					}
+					if ((bestBone(i2)==-1)||(e<best(i2))||((e==best(i2))&&(j<bestBone(i2)))) {
+						best(i2)=e;
+						bestBone(i2)=j;
 					}
 				}
 			}
+
+			for (int i2 : touched)
+				if (state[i2]==Untouched) {
+					state[i2]=Frontier;
+					frontier.push_back(i2);
+				}
+
+			added.clear();
+			if (frontier.empty()) break;
+			_Scalar eMin=best(frontier[0]);
+			for (int i2 : frontier) eMin=std::min(eMin, best(i2));
+			int nKeep=0;
+			for (int i2 : frontier)
+				if (best(i2)<=eMin+step) {
+					state[i2]=Labeled;
+					newLabel(i2)=bestBone(i2);
+					added.push_back(i2);
+				} else frontier[nKeep++]=i2;
+			frontier.resize(nKeep);
 		}
+		for (int i=0; i<nV; i++) if (newLabel(i)!=-1) label(i)=newLabel(i);
 
 		#pragma omp parallel for
 		for (int i=0; i<nV; i++) 
 			if (label(i)==-1) {
 				_Scalar gMin;
 				for (int j=0; j<nB; j++) {
-					_Scalar ej=errorVtxBone(i, j, false);
+					_Scalar ej=errorVtxBone(i, j);
 					if ((label(i)==-1)||(gMin>ej)) {
 						gMin=ej;
 						label(i)=j;
@@ -508,12 +915,16 @@ private:
 	*/
 	void computeTransFromLabel() {
 		m=Matrix4::Identity().replicate(nF, nB);
-		#pragma omp parallel for
-		for (int k=0; k<nF; k++) {
-			MatrixX qpT=MatrixX::Zero(4, 4*nB);
-			for (int i=0; i<nV; i++) 
-				if (label(i)!=-1) qpT.blk4(0, label(i))+=Vector4(v.vec3(k, i).template cast<_Scalar>().homogeneous())*u.vec3(subjectID(k), i).homogeneous().transpose();
-			for (int j=0; j<nB; j++) qpT2m(qpT.blk4(0, j), k, j);
+		int nK=frameBlockSize();
+		for (int k0=0; k0<nF; k0+=nK) {
+			int k1=std::min(k0+nK, nF);
+			#pragma omp parallel for
+			for (int k=k0; k<k1; k++) {
+				MatrixX qpT=MatrixX::Zero(4, 4*nB);
+				for (int i=0; i<nV; i++) 
+					if (label(i)!=-1) qpT.blk4(0, label(i))+=Vector4(v.vec3(k, i).template cast<_Scalar>().homogeneous())*u.vec3(subjectID(k), i).homogeneous().transpose();
+				for (int j=0; j<nB; j++) qpT2m(qpT.blk4(0, j), k, j);
+			}
 		}
 	}
 
@@ -526,6 +937,94 @@ private:
 		w.setFromTriplets(trip.begin(), trip.end());
 	}
 
+	/** Cluster the vertices in to #nB bones with k-means++ on their trajectories and fit the bone transformations to the clusters
+		@details Each column of #v is projected to at most 32 dimensions with a fixed Gaussian matrix, which keeps the distances
+		between trajectories up to a small distortion. The projections are seeded with k-means++ and refined with up to #nInitIters
+		Lloyd iterations, the distances to the centers are computed as matrix products over chunks of vertices. The transformations
+		are fitted once, then computeLabel() turns the clusters in to connected regions and pruneBones() drops bones with less than
+		#nnz vertices. The result does not depend on the number of threads.
+	*/
+	void initKMeans() {
+		const int nChunk=1024;
+		int nD=std::min(nF*3, 32);
+		MatrixX p(nD, nV);
+		std::mt19937 rng(0);
+		if (nD==nF*3) p=v.template cast<_Scalar>();
+		else {
+			std::normal_distribution<_Scalar> normal;
+			MatrixX r(nD, nF*3);
+			for (int c=0; c<r.size(); c++) r.data()[c]=normal(rng);
+			#pragma omp parallel for
+			for (int i0=0; i0<nV; i0+=nChunk) {
+				int n=std::min(nChunk, nV-i0);
+				p.middleCols(i0, n).noalias()=r*v.middleCols(i0, n).template cast<_Scalar>();
+			}
+		}
+
+		//k-means++ seeding, each center is drawn with probability proportional to the squared distance to the closest center
+		int nK=std::min(nB, nV);
+		MatrixX c(nD, nK);
+		VectorX d2(nV);
+		c.col(0)=p.col(std::uniform_int_distribution<int>(0, nV-1)(rng));
+		#pragma omp parallel for
+		for (int i=0; i<nV; i++) d2(i)=(p.col(i)-c.col(0)).squaredNorm();
+		std::uniform_real_distribution<_Scalar> uniform;
+		for (int j=1; j<nK; j++) {
+			_Scalar sum=d2.sum();
+			if (sum<=0) {
+				nK=j;
+				break;
+			}
+			_Scalar target=uniform(rng)*sum;
+			int pick=nV-1;
+			for (int i=0; i<nV; i++) {
+				target-=d2(i);
+				if (target<=0) {
+					pick=i;
+					break;
+				}
+			}
+			c.col(j)=p.col(pick);
+			#pragma omp parallel for
+			for (int i=0; i<nV; i++) d2(i)=std::min(d2(i), (p.col(i)-c.col(j)).squaredNorm());
+		}
+		c.conservativeResize(nD, nK);
+
+		//Lloyd iterations
+		label=Eigen::VectorXi::Constant(nV, -1);
+		for (int it=0; it<std::max(nInitIters, 1); it++) {
+			VectorX cNorm=c.colwise().squaredNorm().transpose();
+			int nChanged=0;
+			#pragma omp parallel for reduction(+:nChanged)
+			for (int i0=0; i0<nV; i0+=nChunk) {
+				int n=std::min(nChunk, nV-i0);
+				MatrixX dist=(_Scalar(-2)*c.transpose()*p.middleCols(i0, n)).colwise()+cNorm;
+				for (int t=0; t<n; t++) {
+					int j;
+					dist.col(t).minCoeff(&j);
+					if (label(i0+t)!=j) {
+						label(i0+t)=j;
+						nChanged++;
+					}
+				}
+			}
+			if (nChanged==0) break;
+
+			MatrixX sum=MatrixX::Zero(nD, nK);
+			Eigen::VectorXi count=Eigen::VectorXi::Zero(nK);
+			for (int i=0; i<nV; i++) {
+				sum.col(label(i))+=p.col(i);
+				count(label(i))++;
+			}
+			for (int j=0; j<nK; j++) if (count(j)>0) c.col(j)=sum.col(j)/_Scalar(count(j));
+		}
+
+		nB=nK;
+		computeTransFromLabel();
+		computeLabel();
+		pruneBones(nnz);
+	}
+
 	/** Split bone clusters
 		@param maxB is the maximum number of bones
 		@param threshold*2 is the minimum size of the bone cluster to be splited 
@@ -549,7 +1048,7 @@ private:
 		for (int i=0; i<nV; i++) {
 			int j=label(i);
 
-			double e=errorVtxBone(i, j, false);
+			double e=errorVtxBone(i, j);
 			#pragma omp atomic
 			ce(j)+=e;
 
@@ -613,7 +1112,7 @@ private:
 		for (int i=0; i<nV; i++) {
 			_Scalar gMin;
 			for (int j=0; j<nB; j++) {
-				_Scalar ej=errorVtxBone(i, j, false);
+				_Scalar ej=errorVtxBone(i, j);
 				if ((label(i)==-1)||(gMin>ej)) {
 					gMin=ej;
 					label(i)=j;
@@ -628,21 +1127,67 @@ private:
 	MatrixX vuT;
 
 	/** Pre-compute vuT with bone translations affinity soft constraint
+		@details The sum over vertices is done as dense-sparse products v.middleRows(3*k0, 3*n)*wu, where wu.size = (nV, 4*nB) and
+		wu(i, j*4+c) = w(j, i)*u.vec3(s, i).homogeneous()(c), so the pow() of the affinity weights is taken once per weight instead
+		of once per frame. Frames are converted to _Scalar in chunks of 16 to bound the temporary memory.
 	*/
 	void compute_vuT() {
 		vuT=MatrixX::Zero(nF*4, nB*4);
-		#pragma omp parallel for
-		for (int k=0; k<nF; k++) {
-			MatrixX vuTp=MatrixX::Zero(4, nB*4);
-			for (int i=0; i<nV; i++)
+
+		std::vector<SparseMatrix> wu(nS), wpu(nS);
+		MatrixX wuSum(nS, nB*4), wpuSum(nS, nB*4);
+		std::vector<Triplet, Eigen::aligned_allocator<Triplet>> trip, tripP;
+		trip.reserve(w.nonZeros()*4);
+		tripP.reserve(w.nonZeros()*4);
+		for (int s=0; s<nS; s++) {
+			trip.clear();
+			tripP.clear();
+			for (int i=0; i<nV; i++) {
+				Vector4 _u=u.vec3(s, i).homogeneous();
 				for (typename SparseMatrix::InnerIterator it(w, i); it; ++it) {
-					Matrix4 tmp=Vector4(v.vec3(k, i).template cast<_Scalar>().homogeneous())*u.vec3(subjectID(k), i).homogeneous().transpose();
-					vuT.blk4(k, it.row())+=it.value()*tmp;
-					vuTp.blk4(0, it.row())+=pow(it.value(), transAffineNorm)*tmp;
+					_Scalar wp=pow(it.value(), transAffineNorm);
+					for (int c=0; c<4; c++) {
+						trip.push_back(Triplet(i, it.row()*4+c, it.value()*_u(c)));
+						tripP.push_back(Triplet(i, it.row()*4+c, wp*_u(c)));
+					}
+				}
+			}
+			wu[s].resize(nV, nB*4);
+			wu[s].setFromTriplets(trip.begin(), trip.end());
+			wpu[s].resize(nV, nB*4);
+			wpu[s].setFromTriplets(tripP.begin(), tripP.end());
+			//The homogeneous row of v is all ones
+			wuSum.row(s)=VectorX::Ones(nV).transpose()*wu[s];
+			wpuSum.row(s)=VectorX::Ones(nV).transpose()*wpu[s];
+		}
+
+		const int vuTChunk=16;
+		int nK=frameBlockSize();
+		for (int k0=0; k0<nF; k0+=nK) {
+			int k1=std::min(k0+nK, nF);
+			int nChunks=(k1-k0+vuTChunk-1)/vuTChunk;
+			#pragma omp parallel for
+			for (int c=0; c<nChunks; c++) {
+				int c1=std::min(k0+(c+1)*vuTChunk, k1);
+				for (int a=k0+c*vuTChunk; a<c1; ) {
+					int s=subjectID(a);
+					int b=std::min(c1, (int)fStart(s+1));
+					MatrixX vb=v.middleRows(a*3, (b-a)*3).template cast<_Scalar>();
+					MatrixX p=vb*wu[s];
+					MatrixX pp=vb*wpu[s];
+					for (int k=a; k<b; k++) {
+						vuT.block(k*4, 0, 3, nB*4)=p.middleRows((k-a)*3, 3);
+						vuT.row(k*4+3)=wuSum.row(s);
+						for (int j=0; j<nB; j++)
+							if (wpuSum(s, j*4+3)!=0) {
+								_Scalar scale=transAffine*vuT(k*4+3, j*4+3)/wpuSum(s, j*4+3);
+								vuT.block(k*4, j*4, 3, 4)+=scale*pp.block((k-a)*3, j*4, 3, 4);
+								vuT.block(k*4+3, j*4, 1, 4)+=scale*wpuSum.block(s, j*4, 1, 4);
+							}
+					}
+					a=b;
 				}
-			for (int j=0; j<nB; j++)
-				if (vuTp(3, j*4+3)!=0)
-					vuT.blk4(k, j)+=(transAffine*vuT(k*4+3, j*4+3)/vuTp(3, j*4+3))*vuTp.blk4(0, j);
+			}
 		}
 	}
 	
@@ -657,7 +1202,6 @@ private:
 	*/
 	void compute_uuT() {
 		Eigen::MatrixXi pos=Eigen::MatrixXi::Constant(nB, nB, -1);
-		#pragma omp parallel for
 		for (int i=0; i<nV; i++)
 			for (typename SparseMatrix::InnerIterator it(w, i); it; ++it)
 				for (typename SparseMatrix::InnerIterator jt(w, i); jt; ++jt)
@@ -676,26 +1220,35 @@ private:
 		}
 		uuT.outerIdx(nB)=nnz;
 		uuT.innerIdx.conservativeResize(nnz);
-		uuT.val=MatrixX::Zero(nS*4, nnz*4);
 
-		#pragma omp parallel for
-		for (int i=0; i<nV; i++)
-			for (typename SparseMatrix::InnerIterator it(w, i); it; ++it)
-				for (typename SparseMatrix::InnerIterator jt(w, i); jt; ++jt)
-					if (it.row()>=jt.row()) {
-						double _w=it.value()*jt.value();
-						MatrixX _uuT(4*nS, 4);
-						Vector4 _u;
-						for (int s=0; s<nS; s++) {
-							_u=u.vec3(s, i).homogeneous();
-							_uuT.blk4(s, 0)=_w*_u*_u.transpose();
+		//Each thread accumulates a static range of vertices in to its own buffer, the buffers are summed in thread order
+		int nThreads=1;
+		#ifdef _OPENMP
+		nThreads=omp_get_max_threads();
+		#endif
+		std::vector<MatrixX, Eigen::aligned_allocator<MatrixX>> partial(nThreads, MatrixX::Zero(nS*4, nnz*4));
+		#pragma omp parallel num_threads(nThreads)
+		{
+			int t=0;
+			#ifdef _OPENMP
+			t=omp_get_thread_num();
+			#endif
+			MatrixX& val=partial[t];
+			#pragma omp for schedule(static)
+			for (int i=0; i<nV; i++)
+				for (typename SparseMatrix::InnerIterator it(w, i); it; ++it)
+					for (typename SparseMatrix::InnerIterator jt(w, i); jt; ++jt)
+						if (it.row()>=jt.row()) {
+							_Scalar _w=it.value()*jt.value();
+							int p=pos(it.row(), jt.row());
+							for (int s=0; s<nS; s++) {
+								Vector4 _u=u.vec3(s, i).homogeneous();
+								val.blk4(s, p)+=_w*_u*_u.transpose();
+							}
 						}
-						int p=pos(it.row(), jt.row())*4;
-						for (int c=0; c<4; c++)
-							for (int r=0; r<4*nS; r++)
-								#pragma omp atomic
-								uuT.val(r, p+c)+=_uuT(r, c);
-					}
+		}
+		uuT.val=partial[0];
+		for (int t=1; t<nThreads; t++) uuT.val+=partial[t];
 
 		for (int i=0; i<nB; i++)
 			for (int j=i+1; j<nB; j++)
@@ -708,41 +1261,47 @@ private:
 	//! mTm.size = (4*nS*nB, 4*nB), where mTm.block<4, 4>(s*nB+i, j) = \sum_{k=fStart(s)}^{fStart(s+1)-1} m.block<3, 4>(k*4, i*4)^T*m.block<3, 4>(k*4, j*4)
 	MatrixX mTm;
 
-	/** Pre-compute mTm for weights update
+	//! mPack.size = (3*nF, 4*nB), mPack.block<3, 4>(k*3, j*4) = m.block<3, 4>(k*4, j*4), each bone is a contiguous column block for compute_mTm() and compute_aTb()
+	MatrixX mPack;
+
+	/** Pre-compute mPack and mTm for weights update
+		@details mTm is the Gram matrix of the rows of mPack that belong to each subject, a single matrix-matrix product per subject.
 	*/
 	void compute_mTm() {
-		Eigen::MatrixXi idx(2, nB*(nB+1)/2);
-		int nPairs=0;
-		for (int i=0; i<nB; i++)
-			for (int j=i; j<nB; j++) {
-				idx(0, nPairs)=i;
-				idx(1, nPairs)=j;
-				nPairs++;
-			}
-
-		mTm=MatrixX::Zero(nS*nB*4, nB*4);
+		mPack.resize(nF*3, nB*4);
 		#pragma omp parallel for
-		for (int p=0; p<nPairs; p++) {
-			int i=idx(0, p);
-			int j=idx(1, p);
-			for (int k=0; k<nF; k++)
-				mTm.blk4(subjectID(k)*nB+i, j)+=m.blk4(k, i).template topRows<3>().transpose()*m.blk4(k, j).template topRows<3>();
-			if (i!=j) for (int s=0; s<nS; s++) mTm.blk4(s*nB+j, i)=mTm.blk4(s*nB+i, j);
+		for (int j=0; j<nB*4; j++)
+			for (int k=0; k<nF; k++) mPack.col(j).template segment<3>(k*3)=m.col(j).template segment<3>(k*4);
+
+		mTm.resize(nS*nB*4, nB*4);
+		for (int s=0; s<nS; s++) {
+			auto ms=mPack.middleRows(fStart(s)*3, (fStart(s+1)-fStart(s))*3);
+			mTm.middleRows(s*nB*4, nB*4).noalias()=ms.transpose()*ms;
 		}
 	}
 
 	//! aTb.col(i) is the A^Tb for vertex i, where A.size = (3*nF, nB), A.col(j).segment<3>(f*3) is the transformed position of vertex i by bone j at frame f, b = v.col(i).
 	MatrixX aTb;
 
-	/** Pre-compute aTb for weights update
+	/** Compute the missing aTb values of one vertex for weights update, the values are kept for the remaining weights iterations
+		@details aTb(j, i) = \sum_s u.vec3(s, i).homogeneous()^T*mPack_s.middleCols<4>(j*4)^T*v_s.col(i), where the product streams the
+		contiguous column block of bone j in #mPack. Requires compute_mTm().
+		@param i is the vertex index.
+		@param bones are the bone indices.
 	*/
-	void compute_aTb() {
-		#pragma omp parallel for
-		for (int i=0; i<nV; i++)
-			for (int j=0; j<nB; j++)
-				if ((aTb(j, i)==0)&&(ws(j, i)>weightEps))
-					for (int k=0; k<nF; k++)
-						aTb(j, i)+=v.vec3(k, i).template cast<_Scalar>().dot(m.blk4(k, j).template topRows<3>()*u.vec3(subjectID(k), i).homogeneous());
+	template<class IndexType>
+	void compute_aTb(int i, const IndexType& bones) {
+		VectorX vi;
+		for (int c=0; c<(int)bones.size(); c++) {
+			int j=bones(c);
+			if (aTb(j, i)!=0) continue;
+			if (vi.size()==0) vi=v.col(i).template cast<_Scalar>();
+			for (int s=0; s<nS; s++) {
+				int r=fStart(s)*3, n=(fStart(s+1)-fStart(s))*3;
+				Vector4 mv=mPack.block(r, j*4, n, 4).transpose()*vi.segment(r, n);
+				aTb(j, i)+=u.vec3(s, i).homogeneous().dot(mv);
+			}
+		}
 	}
 
 	//! Size of the model=RMS distance to centroid
@@ -754,7 +1313,40 @@ private:
 	//! LU factorization of Laplacian
 	Eigen::SparseLU<SparseMatrix> smoothSolver;
 
-	/** Pre-compute Laplacian and LU factorization
+	//! Symmetric form D*#laplacian of the smoothing system, D is the diagonal of the edge weights, for #iterativeSmooth
+	SparseMatrix smoothMatrix;
+
+	//! Diagonal D of #smoothMatrix, the right hand sides are scaled by it
+	VectorX smoothDiag;
+
+	//! Incomplete Cholesky factor of #smoothMatrix
+	typedef Eigen::IncompleteCholesky<_Scalar, Eigen::Lower, Eigen::AMDOrdering<int>> SmoothPreconditioner;
+	SmoothPreconditioner smoothPreconditioner;
+
+	//! Value of #iterativeSmooth when the smoothing solver was computed
+	bool smoothBuiltIterative;
+
+	//! true when the weights are smoothed with conjugate gradients, false when the incomplete Cholesky factorization failed and #smoothSolver is used
+	bool smoothConjugateGradient;
+
+	/** @brief Preconditioner that applies #smoothPreconditioner without owning it
+		@details Lets every thread run its own Eigen::ConjugateGradient on #smoothMatrix while the factorization is computed once.
+	*/
+	class SharedSmoothPreconditioner {
+	public:
+		SharedSmoothPreconditioner(): factor(nullptr) {}
+		template<typename MatType> explicit SharedSmoothPreconditioner(const MatType&): factor(nullptr) {}
+		void setFactor(const SmoothPreconditioner* f) { factor=f; }
+		template<typename MatType> SharedSmoothPreconditioner& analyzePattern(const MatType&) { return *this; }
+		template<typename MatType> SharedSmoothPreconditioner& factorize(const MatType&) { return *this; }
+		template<typename MatType> SharedSmoothPreconditioner& compute(const MatType&) { return *this; }
+		template<typename Rhs> VectorX solve(const Rhs& b) const { return factor->solve(b); }
+		Eigen::ComputationInfo info() const { return factor?factor->info():Eigen::InvalidInput; }
+	private:
+		const SmoothPreconditioner* factor;
+	};
+
+	/** Pre-compute Laplacian and LU factorization, or the preconditioner with #iterativeSmooth
 	*/
 	void computeSmoothSolver() {
 		int nFV=(int)fv.size();
@@ -770,8 +1362,11 @@ private:
 		}
 		epsDis=epsDis*weightEps/(_Scalar)nS;
 
-		std::vector<Triplet, Eigen::aligned_allocator<Triplet>> triplet;
-		VectorX d=VectorX::Zero(nV);
+		//One slot per polygon corner, the value of the edge to the next corner, merged in corner order after the parallel loop
+		std::vector<int> fOffset(nFV+1);
+		fOffset[0]=0;
+		for (int f=0; f<nFV; f++) fOffset[f+1]=fOffset[f]+(int)fv[f].size();
+		VectorX edgeVal=VectorX::Zero(fOffset[nFV]);
 
 		#pragma omp parallel for
 		for (int f=0; f<nFV; f++) {
@@ -787,16 +1382,24 @@ private:
 						for (int k=fStart(s); k<fStart(s+1); k++)
 							val+=pow((v.vec3(k, i).template cast<_Scalar>()-v.vec3(k, j).template cast<_Scalar>()).norm()-du, 2);
 					}
-					val=1/(sqrt(val/nF)+epsDis);
+					edgeVal(fOffset[f]+g)=1/(sqrt(val/nF)+epsDis);
+				}
+			}
+		}
 
-					#pragma omp critical
+		std::vector<Triplet, Eigen::aligned_allocator<Triplet>> triplet;
+		triplet.reserve(2*fOffset[nFV]+nV);
+		VectorX d=VectorX::Zero(nV);
+		for (int f=0; f<nFV; f++) {
+			int nf=(int)fv[f].size();
+			for (int g=0; g<nf; g++) {
+				int i=fv[f][g];
+				int j=fv[f][(g+1)%nf];
+				if (i<j) {
+					_Scalar val=edgeVal(fOffset[f]+g);
 					triplet.push_back(Triplet(i, j, -val));
-					#pragma omp atomic
 					d(i)+=val;
-
-					#pragma omp critical
 					triplet.push_back(Triplet(j, i, -val));
-					#pragma omp atomic
 					d(j)+=val;
 				}
 			}
@@ -808,23 +1411,64 @@ private:
 		laplacian.resize(nV, nV);
 		laplacian.setFromTriplets(triplet.begin(), triplet.end());
 
-		for (int i=0; i<nV; i++)
-			if (d(i)!=0) laplacian.row(i)/=d(i);
+		if (iterativeSmooth) {
+			//Multiplying the rows of the system below by d gives the symmetric positive definite weightsSmoothStep*L+D
+			smoothDiag=(d.array()==0).select(VectorX::Ones(nV), d);
+			smoothMatrix=weightsSmoothStep*laplacian+SparseMatrix(smoothDiag.asDiagonal());
+			smoothPreconditioner.compute(smoothMatrix);
+			smoothConjugateGradient=(smoothPreconditioner.info()==Eigen::Success);
+			if (!smoothConjugateGradient) {
+				std::cout << "Incomplete Cholesky factorization failed, smoothing with the sparse LU solver." << std::endl;
+				smoothMatrix.resize(0, 0);
+			}
+		} else {
+			smoothConjugateGradient=false;
+			smoothMatrix.resize(0, 0);
+		}
+		smoothBuiltIterative=iterativeSmooth;
+
+		//Row scaling through the columns, a row of a column major matrix visits every column
+		for (int j=0; j<nV; j++)
+			for (typename SparseMatrix::InnerIterator it(laplacian, j); it; ++it)
+				if (d(it.row())!=0) it.valueRef()/=d(it.row());
 
 		laplacian=weightsSmoothStep*laplacian+SparseMatrix((VectorX::Ones(nV)).asDiagonal());
-		smoothSolver.compute(laplacian);
+		if (!smoothConjugateGradient) smoothSolver.compute(laplacian);
 	}
 
 	//! Smoothed skinning weights
 	MatrixX ws;
 
 	/** Implicit skinning weights Laplacian smoothing
+		@details With #iterativeSmooth each bone is solved with conjugate gradients from its smoothed weights of the previous call,
+		the bones run in parallel with a solver per thread on the shared matrix and preconditioner.
 	*/
 	void compute_ws() {
-		ws=w.transpose();
-		#pragma omp parallel for
-		for (int j=0; j<nB; j++) ws.col(j)=smoothSolver.solve(ws.col(j));
-		ws.transposeInPlace();
+		if ((laplacian.cols()!=nV)||(iterativeSmooth!=smoothBuiltIterative)) computeSmoothSolver();
+		if (smoothConjugateGradient) {
+			bool warm=(ws.rows()==nB)&&(ws.cols()==nV);
+			MatrixX b=w.transpose();
+			if (!warm) ws=b.transpose();
+			#pragma omp parallel
+			{
+				Eigen::ConjugateGradient<SparseMatrix, Eigen::Lower|Eigen::Upper, SharedSmoothPreconditioner> cg;
+				cg.preconditioner().setFactor(&smoothPreconditioner);
+				cg.setMaxIterations(nV);
+				cg.setTolerance(smoothTolerance);
+				cg.compute(smoothMatrix);
+				#pragma omp for schedule(dynamic)
+				for (int j=0; j<nB; j++) {
+					VectorX x0=ws.row(j).transpose();
+					b.col(j)=cg.solveWithGuess(VectorX(smoothDiag.cwiseProduct(b.col(j))), x0);
+				}
+			}
+			ws=b.transpose();
+		} else {
+			ws=w.transpose();
+			#pragma omp parallel for
+			for (int j=0; j<nB; j++) ws.col(j)=smoothSolver.solve(ws.col(j));
+			ws.transposeInPlace();
+		}
 
 		#pragma omp parallel for
 		for (int i=0; i<nV; i++) {
@@ -837,18 +1481,162 @@ private:
 	//! Per-vertex weights solver
 	ConvexLS<_Scalar> wSolver;
 
+	//! Per-vertex weights solver of up to 8 bones that keeps all its matrices on the stack
+	ConvexLS<_Scalar, 8> wSolverFixed;
+
+	/** Solve the weights of every vertex for one weights update iteration
+		@param solver is #wSolverFixed when at most 8 bones are solved per vertex, #wSolver otherwise. The per-vertex systems use
+		the fixed size bound of the solver and the sort buffers are reused by all the vertices of a thread.
+		@param reg is the weight of the smoothness regularizer.
+		@param boneAdjacency are the bone neighbours from computeBoneAdjacency() when #nCandidates is positive.
+		@param maxCandidates is the maximum number of bones solved per vertex.
+		@param slots is the by-reference output, the weights of vertex i are slots[i*min(#nnz, #nB)+c] for c < slotCount[i].
+		@param slotCount is the by-reference output number of weights of each vertex.
+	*/
+	template<class Solver>
+	void solveWeights(Solver& solver, _Scalar reg, const std::vector<std::vector<int>>& boneAdjacency, int maxCandidates,
+			std::vector<Triplet, Eigen::aligned_allocator<Triplet>>& slots, std::vector<int>& slotCount) {
+		using MatrixS=typename Solver::MatrixX;
+		using VectorS=typename Solver::VectorX;
+		using ArrayS=typename Solver::ArrayXi;
+		int nSlots=std::min(nnz, nB);
+
+		#pragma omp parallel
+		{
+			VectorX wsi, wi;
+			Eigen::ArrayXi idx;
+			#pragma omp for
+			for (int i=0; i<nV; i++) {
+				wsi=ws.col(i);
+				idx=Eigen::ArrayXi::LinSpaced(nB, 0, nB-1);
+				int nnzi=std::min(nnz, nB);
+				//Only the #nnz largest smoothed weights are used, ties go to the lower bone index
+				std::partial_sort(idx.data(), idx.data()+nnzi, idx.data()+nB, [&wsi](int i1, int i2) { return (wsi(i1)>wsi(i2))||((wsi(i1)==wsi(i2))&&(i1<i2)); });
+				while (wsi(idx(nnzi-1))<weightEps) nnzi--;
+				int nci=(nCandidates>0)?addCandidates(i, boneAdjacency, maxCandidates, idx, nnzi):nnzi;
+
+				//A^TA and A^Tb are only needed for the candidate bones
+				compute_aTb(i, idx.head(nci));
+				MatrixS aTai;
+				compute_aTa(i, idx.head(nci), aTai);
+				aTai+=reg*MatrixS::Identity(nci, nci);
+				VectorS aTbi=indexing_vector(aTb.col(i), idx.head(nci))+reg*indexing_vector(wsi, idx.head(nci));
+
+				wi.setZero(nB);
+				for (typename SparseMatrix::InnerIterator it(w, i); it; ++it) wi(it.row())=std::max(it.value(), _Scalar(0));
+				VectorS x(nci);
+				for (int j=0; j<nci; j++) x(j)=wi(idx(j));
+				_Scalar s=x.sum();
+				if (s>_Scalar(0.1)) x/=s; else x=VectorS::Constant(nci, _Scalar(1)/nci);
+
+				solver.solve(aTai, aTbi, x, true, true);
+
+				if (nci>nnzi) {
+					//Keep the #nnz largest weights of the candidates and solve again on those
+					ArrayS order=ArrayS::LinSpaced(nci, 0, nci-1);
+					std::sort(order.data(), order.data()+nci, [&x](int i1, int i2) { return x(i1)>x(i2); });
+					int nKeep=std::min(nnz, nci);
+					while ((nKeep>1)&&(x(order(nKeep-1))==0)) nKeep--;
+					std::sort(order.data(), order.data()+nKeep);
+					ArrayS keep(nKeep);
+					VectorS xKeep(nKeep);
+					for (int c=0; c<nKeep; c++) {
+						keep(c)=idx(order(c));
+						xKeep(c)=x(order(c));
+					}
+					_Scalar sKeep=xKeep.sum();
+					if (sKeep>0) xKeep/=sKeep; else xKeep=VectorS::Constant(nKeep, _Scalar(1)/nKeep);
+					solver.solve(indexing_row_col(aTai, order.head(nKeep), order.head(nKeep)), indexing_vector(aTbi, order.head(nKeep)), xKeep, true, true);
+					idx.head(nKeep)=keep;
+					x=xKeep;
+					nci=nKeep;
+				}
+
+				int count=0;
+				for (int j=0; j<nci; j++)
+					if (x(j)!=0) slots[i*nSlots+count++]=Triplet(idx[j], i, x(j));
+				slotCount[i]=count;
+			}
+		}
+	}
+
 	/** Pre-compute aTa for weights update on one vertex
 		@param i is the vertex index.
-		@param aTa is the by-reference output of A^TA for vertex i, where A.size = (3*nF, nB), A.col(j).segment<3>(f*3) is the transformed position of vertex i by bone j at frame f.
+		@param bones are the bone indices of the rows and columns.
+		@param aTa is the by-reference output of A^TA for vertex i, where A.size = (3*nF, bones.size()), A.col(c).segment<3>(f*3) is the transformed position of vertex i by bone bones(c) at frame f.
 	*/
-	void compute_aTa(int i, MatrixX& aTa) {
-		aTa=MatrixX::Zero(nB, nB);
-		for (int j1=0; j1<nB; j1++)
-			for (int j2=j1; j2<nB; j2++) {
-				for (int s=0; s<nS; s++) aTa(j1, j2)+=u.vec3(s, i).homogeneous().dot(mTm.blk4(s*nB+j1, j2)*u.vec3(s, i).homogeneous());
-				if (j1!=j2) aTa(j2, j1)=aTa(j1, j2);
+	template<class IndexType, class MatrixType>
+	void compute_aTa(int i, const IndexType& bones, MatrixType& aTa) {
+		int n=(int)bones.size();
+		aTa=MatrixType::Zero(n, n);
+		for (int c1=0; c1<n; c1++)
+			for (int c2=c1; c2<n; c2++) {
+				int j1=bones(c1), j2=bones(c2);
+				for (int s=0; s<nS; s++) aTa(c1, c2)+=u.vec3(s, i).homogeneous().dot(mTm.blk4(s*nB+j1, j2)*u.vec3(s, i).homogeneous());
+				if (c1!=c2) aTa(c2, c1)=aTa(c1, c2);
 			}
 	}
+
+	/** Bone neighbours on the mesh, two bones are neighbours when an edge of #fv joins vertices whose largest weights are on them
+		@param adjacency is the by-reference output, adjacency[j] are the sorted neighbours of bone j.
+	*/
+	void computeBoneAdjacency(std::vector<std::vector<int>>& adjacency) const {
+		Eigen::VectorXi dominant=Eigen::VectorXi::Constant(nV, -1);
+		for (int i=0; i<nV; i++) {
+			_Scalar wMax=0;
+			for (typename SparseMatrix::InnerIterator it(w, i); it; ++it)
+				if (it.value()>wMax) {
+					wMax=it.value();
+					dominant(i)=(int)it.row();
+				}
+		}
+		adjacency.assign(nB, std::vector<int>());
+		for (const std::vector<int>& poly: fv) {
+			int nf=(int)poly.size();
+			for (int g=0; g<nf; g++) {
+				int a=dominant(poly[g]), b=dominant(poly[(g+1)%nf]);
+				if ((a!=-1)&&(b!=-1)&&(a!=b)) {
+					adjacency[a].push_back(b);
+					adjacency[b].push_back(a);
+				}
+			}
+		}
+		for (std::vector<int>& neighbours: adjacency) {
+			std::sort(neighbours.begin(), neighbours.end());
+			neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+		}
+	}
+
+	/** Add up to #nCandidates neighbours of the current bones of a vertex after its selected bones
+		@param i is the vertex index.
+		@param adjacency is the output of computeBoneAdjacency().
+		@param maxCandidates is the maximum total number of candidates.
+		@param idx is the bone order of the vertex, the candidates are moved right after its first @p nSelected entries.
+		@param nSelected is the number of bones already selected.
+		@return The total number of candidates.
+	*/
+	int addCandidates(int i, const std::vector<std::vector<int>>& adjacency, int maxCandidates, Eigen::ArrayXi& idx, int nSelected) const {
+		std::vector<bool> used(nB, false);
+		for (int c=0; c<nSelected; c++) used[idx(c)]=true;
+		std::vector<int> extra;
+		for (typename SparseMatrix::InnerIterator it(w, i); it; ++it) {
+			int j=(int)it.row();
+			if (!used[j]) {
+				used[j]=true;
+				extra.push_back(j);
+			}
+			for (int jn: adjacency[j])
+				if (!used[jn]) {
+					used[jn]=true;
+					extra.push_back(jn);
+				}
+		}
+		//The neighbours with the largest smoothed weights go first
+		std::sort(extra.begin(), extra.end(), [this, i](int j1, int j2) { return (ws(j1, i)>ws(j2, i))||((ws(j1, i)==ws(j2, i))&&(j1<j2)); });
+		int n=std::min(nSelected+(int)extra.size(), maxCandidates);
+		for (int c=nSelected; c<n; c++) idx(c)=extra[c-nSelected];
+		return n;
+	}
 };
 	
 }
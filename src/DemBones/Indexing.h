@@ -8,10 +8,6 @@
 #ifndef DEM_BONES_INDEXING
 #define DEM_BONES_INDEXING
 
-#ifdef _MSC_VER
-#pragma warning(disable:4172)
-#endif
-
 #include <Eigen/Dense>
 
 namespace Dem
@@ -34,7 +30,7 @@ public:
 		ColIndexType::MaxSizeAtCompileTime> MatrixType;
 	indexing_functor_row_col(const ArgType& arg, const RowIndexType& row_indices, const ColIndexType& col_indices)
 		: m_arg(arg), m_rowIndices(row_indices), m_colIndices(col_indices) {}
-	const typename ArgType::Scalar& operator() (Eigen::Index row, Eigen::Index col) const {
+	typename ArgType::Scalar operator() (Eigen::Index row, Eigen::Index col) const {
 		return m_arg(m_rowIndices[row], m_colIndices[col]);
 	}
 };
@@ -68,7 +64,7 @@ public:
 		ArgType::MaxColsAtCompileTime> MatrixType;
 	indexing_functor_row(const ArgType& arg, const RowIndexType& row_indices)
 		: m_arg(arg), m_rowIndices(row_indices) {}
-	const typename ArgType::Scalar& operator() (Eigen::Index row, Eigen::Index col) const {
+	typename ArgType::Scalar operator() (Eigen::Index row, Eigen::Index col) const {
 		return m_arg(m_rowIndices[row], col);
 	}
 };
@@ -102,7 +98,7 @@ public:
 		1> VectorType;
 	indexing_functor_vector(const ArgType& arg, const IndexType& indices)
 		: m_arg(arg), m_indices(indices) {}
-	const typename ArgType::Scalar& operator() (Eigen::Index idx) const {
+	typename ArgType::Scalar operator() (Eigen::Index idx) const {
 		return m_arg(m_indices[idx]);
 	}
 };
@@ -0,0 +1,248 @@
+#include "demBonesCheckpoint.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+static const char kMagic[4] = {'C', 'M', 'T', 'K'};
+static const uint32_t kVersion = 1;
+
+namespace {
+
+class Writer {
+ public:
+  explicit Writer(std::ofstream& out) : out_(out) {}
+
+  template <typename T>
+  void value(T value) {
+    out_.write(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  template <typename T>
+  void values(const T* values, size_t count) {
+    out_.write(reinterpret_cast<const char*>(values), sizeof(T) * count);
+  }
+
+  template <typename Matrix>
+  void dense(const Matrix& matrix) {
+    value<int32_t>(static_cast<int32_t>(matrix.rows()));
+    value<int32_t>(static_cast<int32_t>(matrix.cols()));
+    values(matrix.data(), static_cast<size_t>(matrix.size()));
+  }
+
+ private:
+  std::ofstream& out_;
+};
+
+class Reader {
+ public:
+  Reader(std::ifstream& in, size_t size) : in_(in), remaining_(size) {}
+
+  template <typename T>
+  bool value(T& value) {
+    return values(&value, 1);
+  }
+
+  template <typename T>
+  bool values(T* values, size_t count) {
+    // Checking against the file size keeps a corrupt count from allocating huge buffers
+    if (count > remaining_ / sizeof(T)) {
+      return false;
+    }
+    remaining_ -= sizeof(T) * count;
+    in_.read(reinterpret_cast<char*>(values), sizeof(T) * count);
+    return static_cast<bool>(in_);
+  }
+
+  /** Checks that @p count values of type T are left before a buffer for them is allocated. */
+  template <typename T>
+  bool fits(size_t count) const {
+    return count <= remaining_ / sizeof(T);
+  }
+
+  template <typename Matrix>
+  bool dense(Matrix& matrix) {
+    int32_t rows, cols;
+    if (!value(rows) || !value(cols) || rows < 0 || cols < 0) {
+      return false;
+    }
+    size_t count = static_cast<size_t>(rows) * cols;
+    if (!fits<typename Matrix::Scalar>(count)) {
+      return false;
+    }
+    matrix.resize(rows, cols);
+    return values(matrix.data(), count);
+  }
+
+ private:
+  std::ifstream& in_;
+  size_t remaining_;
+};
+
+}  // namespace
+
+bool DemBonesCheckpoint::save(const std::string& path, const Model& model, int iteration,
+                              std::string& error) {
+  std::string tempPath = path + ".tmp";
+  std::ofstream out(tempPath.c_str(), std::ios::binary | std::ios::trunc);
+  if (!out) {
+    error = "Unable to write " + tempPath;
+    return false;
+  }
+  Writer writer(out);
+  writer.values(kMagic, sizeof(kMagic));
+  writer.value<uint32_t>(kVersion);
+  writer.value<int32_t>(iteration);
+  writer.value<int32_t>(model.nV);
+  writer.value<int32_t>(model.nF);
+  writer.value<int32_t>(model.nS);
+  writer.value<int32_t>(model.nB);
+  writer.value<int32_t>(model.nnz);
+  writer.value<double>(model.weightsSmooth);
+  writer.value<double>(model.weightsSmoothStep);
+
+  writer.dense(model.fStart);
+  writer.dense(model.subjectID);
+  writer.dense(model.fTime);
+  writer.dense(model.m);
+  writer.dense(model.origM);
+  writer.dense(model.label);
+  writer.dense(model.parent);
+  writer.dense(model.bind);
+  writer.dense(model.preMulInv);
+  writer.dense(model.rotOrder);
+
+  Model::SparseMatrix w = model.w;
+  w.makeCompressed();
+  writer.value<int32_t>(static_cast<int32_t>(w.rows()));
+  writer.value<int32_t>(static_cast<int32_t>(w.cols()));
+  writer.value<int32_t>(static_cast<int32_t>(w.nonZeros()));
+  writer.values(w.outerIndexPtr(), static_cast<size_t>(w.cols()) + 1);
+  writer.values(w.innerIndexPtr(), static_cast<size_t>(w.nonZeros()));
+  writer.values(w.valuePtr(), static_cast<size_t>(w.nonZeros()));
+
+  writer.value<int32_t>(static_cast<int32_t>(model.boneName.size()));
+  for (const std::string& name : model.boneName) {
+    writer.value<int32_t>(static_cast<int32_t>(name.size()));
+    writer.values(name.data(), name.size());
+  }
+
+  out.close();
+  if (!out) {
+    error = "Unable to write " + tempPath;
+    std::remove(tempPath.c_str());
+    return false;
+  }
+  // rename does not replace existing files on Windows
+  std::remove(path.c_str());
+  if (std::rename(tempPath.c_str(), path.c_str()) != 0) {
+    error = "Unable to rename " + tempPath + " to " + path;
+    return false;
+  }
+  return true;
+}
+
+bool DemBonesCheckpoint::load(const std::string& path, Model& model, int& iteration,
+                              std::string& error) {
+  std::ifstream in(path.c_str(), std::ios::binary | std::ios::ate);
+  if (!in) {
+    error = "Unable to open " + path;
+    return false;
+  }
+  size_t size = static_cast<size_t>(in.tellg());
+  in.seekg(0);
+  Reader reader(in, size);
+
+  char magic[4];
+  uint32_t version;
+  if (!reader.values(magic, sizeof(magic)) || std::memcmp(magic, kMagic, sizeof(kMagic)) != 0) {
+    error = path + " is not a demBones checkpoint file";
+    return false;
+  }
+  if (!reader.value(version) || version != kVersion) {
+    error = path + " has unsupported version " + std::to_string(version);
+    return false;
+  }
+
+  int32_t header[6];
+  double smooth[2];
+  bool valid = reader.values(header, 6) && reader.values(smooth, 2);
+  valid = valid && reader.dense(model.fStart) && reader.dense(model.subjectID) &&
+          reader.dense(model.fTime) && reader.dense(model.m) && reader.dense(model.origM) &&
+          reader.dense(model.label) && reader.dense(model.parent) && reader.dense(model.bind) &&
+          reader.dense(model.preMulInv) && reader.dense(model.rotOrder);
+
+  int32_t rows = 0, cols = 0, nonZeros = 0;
+  valid = valid && reader.value(rows) && reader.value(cols) && reader.value(nonZeros) &&
+          rows >= 0 && cols >= 0 && nonZeros >= 0 &&
+          reader.fits<int>(static_cast<size_t>(cols) + 1 + nonZeros);
+  if (valid) {
+    std::vector<int> outer(static_cast<size_t>(cols) + 1);
+    std::vector<int> inner(nonZeros);
+    std::vector<double> values(nonZeros);
+    valid = reader.values(outer.data(), outer.size()) &&
+            reader.values(inner.data(), inner.size()) &&
+            reader.values(values.data(), values.size());
+    // The indices are checked before Eigen sees them
+    valid = valid && outer[0] == 0 && outer[cols] == nonZeros;
+    for (int32_t i = 0; valid && i < cols; ++i) {
+      valid = outer[i] <= outer[i + 1];
+    }
+    for (int32_t i = 0; valid && i < nonZeros; ++i) {
+      valid = inner[i] >= 0 && inner[i] < rows;
+    }
+    if (valid) {
+      model.w = Eigen::Map<const Model::SparseMatrix>(rows, cols, nonZeros, outer.data(),
+                                                      inner.data(), values.data());
+    }
+  }
+
+  int32_t nameCount = 0;
+  valid = valid && reader.value(nameCount) && nameCount >= 0;
+  if (valid) {
+    model.boneName.resize(nameCount);
+    for (std::string& name : model.boneName) {
+      int32_t length;
+      valid = valid && reader.value(length) && length >= 0;
+      if (!valid) {
+        break;
+      }
+      name.resize(length);
+      valid = length == 0 || reader.values(&name[0], static_cast<size_t>(length));
+    }
+  }
+
+  // The counts in the header have to agree with the data or the solve would index out of bounds
+  int32_t nV = header[1];
+  int32_t nF = header[2];
+  int32_t nS = header[3];
+  int32_t nB = header[4];
+  valid = valid && nV >= 0 && nF >= 0 && nS >= 0 && nB >= 0 && model.fStart.size() == nS + 1 &&
+          model.fStart(0) == 0 && model.fStart(nS) == nF && model.subjectID.size() == nF &&
+          model.fTime.size() == nF && model.m.rows() == 4 * static_cast<Eigen::Index>(nF) &&
+          model.m.cols() == 4 * static_cast<Eigen::Index>(nB) && model.w.rows() == nB &&
+          model.w.cols() == nV;
+  for (int32_t s = 0; valid && s < nS; ++s) {
+    valid = model.fStart(s) <= model.fStart(s + 1);
+  }
+  for (int32_t k = 0; valid && k < nF; ++k) {
+    valid = model.subjectID(k) >= 0 && model.subjectID(k) < nS;
+  }
+
+  if (!valid) {
+    error = path + " is truncated or corrupt";
+    return false;
+  }
+
+  iteration = header[0];
+  model.nV = header[1];
+  model.nF = header[2];
+  model.nS = header[3];
+  model.nB = header[4];
+  model.nnz = header[5];
+  model.weightsSmooth = smooth[0];
+  model.weightsSmoothStep = smooth[1];
+  return true;
+}
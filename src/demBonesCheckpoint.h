@@ -0,0 +1,53 @@
+#ifndef CMT_DEMBONESCHECKPOINT_H
+#define CMT_DEMBONESCHECKPOINT_H
+
+#include "DemBones/DemBonesExt.h"
+
+#include <string>
+
+/**
+  Snapshot of a demBones solve so a long decomposition can be continued after a crash or
+  extended with more iterations.  The mesh sequence and rest pose are not stored, they are
+  read again from the scene or a point cache.
+
+  Layout (little endian):
+    char[4]  magic "CMTK"
+    uint32   version
+    int32    iteration, nV, nF, nS, nB, nnz
+    double   weightsSmooth, weightsSmoothStep
+    Dense int32 and double arrays are stored as int32 rows, int32 cols and column major values:
+      fStart, subjectID, fTime, m, origM, label, parent, bind, preMulInv, rotOrder
+    w as int32 rows, int32 cols, int32 nonZeros, int32[cols + 1] outer starts,
+      int32[nonZeros] inner indices and double[nonZeros] values
+    boneName as int32 count followed by int32 length and characters per name
+
+  Files are written to a temporary file first and renamed so an interrupted write never
+  replaces a good checkpoint.
+*/
+class DemBonesCheckpoint {
+ public:
+  typedef Dem::DemBonesExt<double, float> Model;
+
+  /**
+    Writes the solve state of a model.
+    @param[in] path File path.
+    @param[in] model Model to save.
+    @param[in] iteration Number of completed global iterations.
+    @param[out] error Error description on failure.
+    @return true on success.
+  */
+  static bool save(const std::string& path, const Model& model, int iteration,
+                   std::string& error);
+
+  /**
+    Reads the solve state in to a model.  Mesh data in the model is left untouched.
+    @param[in] path File path.
+    @param[in,out] model Model to restore.
+    @param[out] iteration Number of completed global iterations.
+    @param[out] error Error description on failure.
+    @return true on success.
+  */
+  static bool load(const std::string& path, Model& model, int& iteration, std::string& error);
+};
+
+#endif
@@ -1,24 +1,35 @@
 #include "demBonesCmd.h"
 #include "common.h"
+#include "demBonesJob.h"
 #ifndef DEM_BONES_MAT_BLOCKS
 #include "DemBones/MatBlocks.h"
 #define DEM_BONES_DEM_BONES_MAT_BLOCKS_UNDEFINED
 #endif
 
+#include <maya/MAngle.h>
 #include <maya/MAnimControl.h>
+#include <maya/MDGContext.h>
+#if MAYA_API_VERSION >= 20190000
+#include <maya/MDGContextGuard.h>
+#endif
 #include <maya/MDagPath.h>
+#include <maya/MDistance.h>
 #include <maya/MEulerRotation.h>
 #include <maya/MFnAnimCurve.h>
 #include <maya/MFnDagNode.h>
 #include <maya/MFnMatrixData.h>
 #include <maya/MFnMesh.h>
-#include <maya/MFnSet.h>
+#include <maya/MFnSingleIndexedComponent.h>
 #include <maya/MFnSkinCluster.h>
 #include <maya/MFnTransform.h>
+#include <maya/MIntArray.h>
+#include <maya/MItDependencyGraph.h>
 #include <maya/MMatrix.h>
 #include <maya/MPlug.h>
 #include <maya/MTime.h>
 
+#include <cmath>
+
 const char* DemBonesCmd::kWeightsSmoothStepShort = "-wss";
 const char* DemBonesCmd::kWeightsSmoothStepLong = "-weightsSmoothStep";
 const char* DemBonesCmd::kWeightsSmoothShort = "-ws";
@@ -47,11 +58,60 @@ const char* DemBonesCmd::kEndFrameShort = "-ef";
 const char* DemBonesCmd::kEndFrameLong = "-endFrame";
 const char* DemBonesCmd::kExistingBonesShort = "-eb";
 const char* DemBonesCmd::kExistingBonesLong = "-existingBones";
+const char* DemBonesCmd::kCacheFileShort = "-cf";
+const char* DemBonesCmd::kCacheFileLong = "-cacheFile";
+const char* DemBonesCmd::kScratchFileShort = "-scf";
+const char* DemBonesCmd::kScratchFileLong = "-scratchFile";
+const char* DemBonesCmd::kFrameBlockShort = "-fb";
+const char* DemBonesCmd::kFrameBlockLong = "-frameBlock";
+const char* DemBonesCmd::kToleranceShort = "-tol";
+const char* DemBonesCmd::kToleranceLong = "-tolerance";
+const char* DemBonesCmd::kPatienceShort = "-pat";
+const char* DemBonesCmd::kPatienceLong = "-patience";
+const char* DemBonesCmd::kMaxTimeShort = "-mt";
+const char* DemBonesCmd::kMaxTimeLong = "-maxTime";
+const char* DemBonesCmd::kCandidatesShort = "-cd";
+const char* DemBonesCmd::kCandidatesLong = "-candidates";
+const char* DemBonesCmd::kMultiResShort = "-mr";
+const char* DemBonesCmd::kMultiResLong = "-multiRes";
+const char* DemBonesCmd::kRefineItersShort = "-ri";
+const char* DemBonesCmd::kRefineItersLong = "-refineIters";
+const char* DemBonesCmd::kCheckpointShort = "-ckp";
+const char* DemBonesCmd::kCheckpointLong = "-checkpoint";
+const char* DemBonesCmd::kCheckpointIntervalShort = "-cki";
+const char* DemBonesCmd::kCheckpointIntervalLong = "-checkpointInterval";
+const char* DemBonesCmd::kResumeShort = "-rs";
+const char* DemBonesCmd::kResumeLong = "-resume";
+const char* DemBonesCmd::kBackgroundShort = "-bg";
+const char* DemBonesCmd::kBackgroundLong = "-background";
+const char* DemBonesCmd::kJobStatusShort = "-js";
+const char* DemBonesCmd::kJobStatusLong = "-jobStatus";
+const char* DemBonesCmd::kJobProgressShort = "-jp";
+const char* DemBonesCmd::kJobProgressLong = "-jobProgress";
+const char* DemBonesCmd::kCancelJobShort = "-cj";
+const char* DemBonesCmd::kCancelJobLong = "-cancelJob";
+const char* DemBonesCmd::kListJobsShort = "-lj";
+const char* DemBonesCmd::kListJobsLong = "-listJobs";
+const char* DemBonesCmd::kCommitJobShort = "-cmj";
+const char* DemBonesCmd::kCommitJobLong = "-commitJob";
+const char* DemBonesCmd::kCommitFinishedShort = "-cmf";
+const char* DemBonesCmd::kCommitFinishedLong = "-commitFinished";
+const char* DemBonesCmd::kInitMethodShort = "-im";
+const char* DemBonesCmd::kInitMethodLong = "-initMethod";
+const char* DemBonesCmd::kIterativeSmoothShort = "-is";
+const char* DemBonesCmd::kIterativeSmoothLong = "-iterativeSmooth";
+const char* DemBonesCmd::kKeyToleranceShort = "-kt";
+const char* DemBonesCmd::kKeyToleranceLong = "-keyTolerance";
+const char* DemBonesCmd::kFrameBudgetShort = "-fbd";
+const char* DemBonesCmd::kFrameBudgetLong = "-frameBudget";
 const MString DemBonesCmd::kName("demBones");
 
 void* DemBonesCmd::creator() { return new DemBonesCmd; }
 
-bool DemBonesCmd::isUndoable() const { return true; }
+DemBonesCmd::DemBonesCmd()
+    : model_(new MyDemBones), keyTolerance_(0.0), addBones_(false), undoable_(true) {}
+
+bool DemBonesCmd::isUndoable() const { return undoable_; }
 
 MSyntax DemBonesCmd::newSyntax() {
   MSyntax syntax;
@@ -68,11 +128,38 @@ MSyntax DemBonesCmd::newSyntax() {
   syntax.addFlag(kInitItersShort, kItersLong, MSyntax::kLong);
   syntax.addFlag(kBonesShort, kBonesLong, MSyntax::kLong);
   syntax.addFlag(kStartFrameShort, kStartFrameLong, MSyntax::kDouble);
+  syntax.makeFlagMultiUse(kStartFrameShort);
   syntax.addFlag(kEndFrameShort, kEndFrameLong, MSyntax::kDouble);
+  syntax.makeFlagMultiUse(kEndFrameShort);
   syntax.addFlag(kExistingBonesShort, kExistingBonesLong, MSyntax::kString);
   syntax.makeFlagMultiUse(kExistingBonesShort);
-
-  syntax.setObjectType(MSyntax::kSelectionList, 1, 1);
+  syntax.addFlag(kCacheFileShort, kCacheFileLong, MSyntax::kString);
+  syntax.makeFlagMultiUse(kCacheFileShort);
+  syntax.addFlag(kScratchFileShort, kScratchFileLong, MSyntax::kString);
+  syntax.addFlag(kFrameBlockShort, kFrameBlockLong, MSyntax::kLong);
+  syntax.addFlag(kToleranceShort, kToleranceLong, MSyntax::kDouble);
+  syntax.addFlag(kPatienceShort, kPatienceLong, MSyntax::kLong);
+  syntax.addFlag(kMaxTimeShort, kMaxTimeLong, MSyntax::kDouble);
+  syntax.addFlag(kCandidatesShort, kCandidatesLong, MSyntax::kLong);
+  syntax.addFlag(kMultiResShort, kMultiResLong, MSyntax::kDouble);
+  syntax.addFlag(kRefineItersShort, kRefineItersLong, MSyntax::kLong);
+  syntax.addFlag(kCheckpointShort, kCheckpointLong, MSyntax::kString);
+  syntax.addFlag(kCheckpointIntervalShort, kCheckpointIntervalLong, MSyntax::kLong);
+  syntax.addFlag(kResumeShort, kResumeLong, MSyntax::kString);
+  syntax.addFlag(kBackgroundShort, kBackgroundLong);
+  syntax.addFlag(kJobStatusShort, kJobStatusLong, MSyntax::kLong);
+  syntax.addFlag(kJobProgressShort, kJobProgressLong, MSyntax::kLong);
+  syntax.addFlag(kCancelJobShort, kCancelJobLong, MSyntax::kLong);
+  syntax.addFlag(kListJobsShort, kListJobsLong);
+  syntax.addFlag(kCommitJobShort, kCommitJobLong, MSyntax::kLong);
+  syntax.addFlag(kCommitFinishedShort, kCommitFinishedLong, MSyntax::kLong);
+  syntax.addFlag(kInitMethodShort, kInitMethodLong, MSyntax::kString);
+  syntax.addFlag(kIterativeSmoothShort, kIterativeSmoothLong, MSyntax::kBoolean);
+  syntax.addFlag(kKeyToleranceShort, kKeyToleranceLong, MSyntax::kDouble);
+  syntax.addFlag(kFrameBudgetShort, kFrameBudgetLong, MSyntax::kLong);
+
+  // The job flags do not take a mesh so the selection is validated in doIt
+  syntax.setObjectType(MSyntax::kSelectionList, 0, 1);
   syntax.useSelectionAsDefault(true);
 
   syntax.enableEdit(false);
@@ -87,23 +174,61 @@ MStatus DemBonesCmd::doIt(const MArgList& argList) {
   MArgDatabase argData(syntax(), argList, &status);
   CHECK_MSTATUS_AND_RETURN_IT(status);
 
+  // Read before the job flags so a committed background job is reduced too
+  if (argData.isFlagSet(kKeyToleranceShort)) {
+    keyTolerance_ = argData.flagArgumentDouble(kKeyToleranceShort, 0, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+  }
+
+  bool handled = false;
+  status = doJobFlags(argData, handled);
+  if (handled) {
+    return status;
+  }
+
   MSelectionList selection;
   status = argData.getObjects(selection);
   CHECK_MSTATUS_AND_RETURN_IT(status);
+  if (selection.length() == 0) {
+    MGlobal::displayError("No mesh specified.");
+    return MS::kInvalidParameter;
+  }
   status = selection.getDagPath(0, pathMesh_);
   CHECK_MSTATUS_AND_RETURN_IT(status);
   status = getShapeNode(pathMesh_);
   CHECK_MSTATUS_AND_RETURN_IT(status);
 
-  double startFrame = MAnimControl::animationStartTime().value();
-  if (argData.isFlagSet(kStartFrameShort)) {
-    startFrame = argData.flagArgumentDouble(kStartFrameShort, 0, &status);
+  // Each frame range is a separate subject of the solve sharing the bones and weights
+  unsigned int startCount =
+      argData.isFlagSet(kStartFrameShort) ? argData.numberOfFlagUses(kStartFrameShort) : 0;
+  unsigned int endCount =
+      argData.isFlagSet(kEndFrameShort) ? argData.numberOfFlagUses(kEndFrameShort) : 0;
+  if ((startCount > 1 || endCount > 1) && startCount != endCount) {
+    MGlobal::displayError("-startFrame and -endFrame must be used the same number of times");
+    return MS::kInvalidParameter;
+  }
+  unsigned int rangeCount = std::max(1u, std::max(startCount, endCount));
+  std::vector<double> startFrames(rangeCount, MAnimControl::animationStartTime().value());
+  std::vector<double> endFrames(rangeCount, MAnimControl::animationEndTime().value());
+  for (unsigned int i = 0; i < startCount; ++i) {
+    MArgList mArgs;
+    status = argData.getFlagArgumentList(kStartFrameShort, i, mArgs);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    startFrames[i] = mArgs.asDouble(0, &status);
     CHECK_MSTATUS_AND_RETURN_IT(status);
   }
-  double endFrame = MAnimControl::animationEndTime().value();
-  if (argData.isFlagSet(kEndFrameShort)) {
-    endFrame = argData.flagArgumentDouble(kEndFrameShort, 0, &status);
+  for (unsigned int i = 0; i < endCount; ++i) {
+    MArgList mArgs;
+    status = argData.getFlagArgumentList(kEndFrameShort, i, mArgs);
     CHECK_MSTATUS_AND_RETURN_IT(status);
+    endFrames[i] = mArgs.asDouble(0, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+  }
+  for (unsigned int i = 0; i < rangeCount; ++i) {
+    if (endFrames[i] < startFrames[i]) {
+      MGlobal::displayError("-endFrame must not be before -startFrame");
+      return MS::kInvalidParameter;
+    }
   }
 
   if (argData.isFlagSet(kExistingBonesShort)) {
@@ -123,128 +248,428 @@ MStatus DemBonesCmd::doIt(const MArgList& argList) {
     }
   }
 
-  status = readMeshSequence(startFrame, endFrame);
-  CHECK_MSTATUS_AND_RETURN_IT(status);
+  // Out of core storage of the mesh sequence for sequences that do not fit in memory.  The
+  // frame parallel solver kernels then work on blocks of frames to bound the resident pages.
+  if (argData.isFlagSet(kScratchFileShort)) {
+    scratchFile_ = argData.flagArgumentString(kScratchFileShort, 0, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    model_->nFrameBlock = 256;
+  }
+  if (argData.isFlagSet(kFrameBlockShort)) {
+    model_->nFrameBlock = argData.flagArgumentInt(kFrameBlockShort, 0, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+  }
+
+  // A point cache replaces evaluating the mesh every frame and defines the frame range.  Each
+  // cache is a separate subject.
+  std::vector<std::unique_ptr<PointCache>> caches;
+  unsigned int cacheCount =
+      argData.isFlagSet(kCacheFileShort) ? argData.numberOfFlagUses(kCacheFileShort) : 0;
+  if (cacheCount) {
+    startFrames.clear();
+    endFrames.clear();
+  }
+  for (unsigned int i = 0; i < cacheCount; ++i) {
+    MArgList mArgs;
+    status = argData.getFlagArgumentList(kCacheFileShort, i, mArgs);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    MString cacheFile = mArgs.asString(0, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    std::unique_ptr<PointCache> cache(new PointCache);
+    std::string error;
+    if (!cache->open(cacheFile.asChar(), error)) {
+      MGlobal::displayError(error.c_str());
+      return MS::kInvalidParameter;
+    }
+    MFnMesh fnMesh(pathMesh_, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    if (cache->vertexCount() != static_cast<unsigned int>(fnMesh.numVertices())) {
+      MGlobal::displayError(cacheFile + " does not match the vertex count of " +
+                            pathMesh_.partialPathName());
+      return MS::kInvalidParameter;
+    }
+    if (cache->frameCount() == 0) {
+      MGlobal::displayError(cacheFile + " has no frames");
+      return MS::kInvalidParameter;
+    }
+    // Cache frames are keyed as scene frames so both have to use the same frame rate
+    double sceneFrameRate = MTime(1.0, MTime::kSeconds).as(MTime::uiUnit());
+    if (std::abs(cache->frameRate() - sceneFrameRate) > 1e-3) {
+      MGlobal::displayError(cacheFile + " was written at " + cache->frameRate() +
+                            " fps but the scene runs at " + sceneFrameRate + " fps");
+      return MS::kInvalidParameter;
+    }
+    startFrames.push_back(cache->startFrame());
+    endFrames.push_back(cache->startFrame() + cache->frameCount() - 1);
+    caches.push_back(std::move(cache));
+  }
+
+  // All the subjects animate the same joints so their keys end up on the same curves
+  std::vector<std::pair<double, double>> ranges;
+  for (size_t i = 0; i < startFrames.size(); ++i) {
+    ranges.push_back(std::make_pair(startFrames[i], endFrames[i]));
+  }
+  std::sort(ranges.begin(), ranges.end());
+  for (size_t i = 1; i < ranges.size(); ++i) {
+    if (ranges[i].first <= ranges[i - 1].second) {
+      MGlobal::displayWarning("demBones frame ranges overlap, the keys of later subjects replace "
+                              "the keys of earlier ones.");
+      break;
+    }
+  }
+
+  MString resumeFile;
+  if (argData.isFlagSet(kResumeShort)) {
+    resumeFile = argData.flagArgumentString(kResumeShort, 0, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+  }
+  bool resume = resumeFile.length() > 0;
+  // -bones with -existingBones adds bones, a resumed solve keeps the bones of the checkpoint
+  addBones_ = argData.isFlagSet(kBonesShort) && !resume;
+  if (resume && !caches.empty()) {
+    status = loadCheckpoint(resumeFile);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    status = readCachedSequence(caches);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+  } else {
+    status = readMeshSequence(startFrames, endFrames, caches);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    if (resume) {
+      status = loadCheckpoint(resumeFile);
+      CHECK_MSTATUS_AND_RETURN_IT(status);
+    }
+  }
 
   status = readBindPose();
   CHECK_MSTATUS_AND_RETURN_IT(status);
 
   if (argData.isFlagSet(kItersShort)) {
-    model_.nIters = argData.flagArgumentInt(kItersShort, 0, &status);
+    model_->nIters = argData.flagArgumentInt(kItersShort, 0, &status);
     CHECK_MSTATUS_AND_RETURN_IT(status);
   }
   if (argData.isFlagSet(kTransItersShort)) {
-    model_.nTransIters = argData.flagArgumentInt(kTransItersShort, 0, &status);
+    model_->nTransIters = argData.flagArgumentInt(kTransItersShort, 0, &status);
     CHECK_MSTATUS_AND_RETURN_IT(status);
   }
   if (argData.isFlagSet(kWeightItersShort)) {
-    model_.nWeightsIters = argData.flagArgumentInt(kWeightItersShort, 0, &status);
+    model_->nWeightsIters = argData.flagArgumentInt(kWeightItersShort, 0, &status);
     CHECK_MSTATUS_AND_RETURN_IT(status);
   }
   if (argData.isFlagSet(kBindUpdateShort)) {
-    model_.bindUpdate = static_cast<int>(argData.flagArgumentBool(kBindUpdateShort, 0, &status));
+    model_->bindUpdate = static_cast<int>(argData.flagArgumentBool(kBindUpdateShort, 0, &status));
     CHECK_MSTATUS_AND_RETURN_IT(status);
   }
   if (argData.isFlagSet(kTransAffineShort)) {
-    model_.transAffine = argData.flagArgumentDouble(kTransAffineShort, 0, &status);
+    model_->transAffine = argData.flagArgumentDouble(kTransAffineShort, 0, &status);
     CHECK_MSTATUS_AND_RETURN_IT(status);
   }
   if (argData.isFlagSet(kTransAffineNormShort)) {
-    model_.transAffineNorm = argData.flagArgumentDouble(kTransAffineNormShort, 0, &status);
+    model_->transAffineNorm = argData.flagArgumentDouble(kTransAffineNormShort, 0, &status);
     CHECK_MSTATUS_AND_RETURN_IT(status);
   }
   if (argData.isFlagSet(kNumNonZeroShort)) {
-    model_.nnz = argData.flagArgumentInt(kNumNonZeroShort, 0, &status);
+    model_->nnz = argData.flagArgumentInt(kNumNonZeroShort, 0, &status);
     CHECK_MSTATUS_AND_RETURN_IT(status);
   }
   if (argData.isFlagSet(kWeightsSmoothShort)) {
-    model_.weightsSmooth = argData.flagArgumentDouble(kWeightsSmoothShort, 0, &status);
+    model_->weightsSmooth = argData.flagArgumentDouble(kWeightsSmoothShort, 0, &status);
     CHECK_MSTATUS_AND_RETURN_IT(status);
   }
   if (argData.isFlagSet(kWeightsSmoothStepShort)) {
-    model_.weightsSmoothStep = argData.flagArgumentDouble(kWeightsSmoothStepShort, 0, &status);
+    model_->weightsSmoothStep = argData.flagArgumentDouble(kWeightsSmoothStepShort, 0, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+  }
+  // Conjugate gradients instead of a sparse LU factorization of the smoothing Laplacian
+  if (argData.isFlagSet(kIterativeSmoothShort)) {
+    model_->iterativeSmooth = argData.flagArgumentBool(kIterativeSmoothShort, 0, &status);
     CHECK_MSTATUS_AND_RETURN_IT(status);
   }
 
   if (argData.isFlagSet(kInitItersShort)) {
-    model_.nInitIters = argData.flagArgumentDouble(kInitItersShort, 0, &status);
+    model_->nInitIters = argData.flagArgumentDouble(kInitItersShort, 0, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+  }
+  // split: LBG-VQ bone splitting, kmeans: k-means++ clustering of the vertex trajectories
+  if (argData.isFlagSet(kInitMethodShort)) {
+    MString initMethod = argData.flagArgumentString(kInitMethodShort, 0, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    if (initMethod == "split") {
+      model_->initMethod = 0;
+    } else if (initMethod == "kmeans") {
+      model_->initMethod = 1;
+    } else {
+      MGlobal::displayError("-initMethod must be split or kmeans");
+      return MS::kInvalidParameter;
+    }
+  }
+  if (argData.isFlagSet(kToleranceShort)) {
+    model_->tolerance = argData.flagArgumentDouble(kToleranceShort, 0, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+  }
+  if (argData.isFlagSet(kPatienceShort)) {
+    model_->patience = argData.flagArgumentInt(kPatienceShort, 0, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+  }
+  if (argData.isFlagSet(kMaxTimeShort)) {
+    model_->maxTime = argData.flagArgumentDouble(kMaxTimeShort, 0, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+  }
+  if (argData.isFlagSet(kCandidatesShort)) {
+    model_->nCandidates = argData.flagArgumentInt(kCandidatesShort, 0, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+  }
+  // Solve on a decimated mesh first and refine the prolongated weights at full resolution
+  if (argData.isFlagSet(kMultiResShort)) {
+    model_->multiResRatio = argData.flagArgumentDouble(kMultiResShort, 0, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    if (model_->multiResRatio <= 0.0) {
+      MGlobal::displayError("-multiRes must be greater than 0");
+      return MS::kInvalidParameter;
+    }
+  }
+  if (argData.isFlagSet(kRefineItersShort)) {
+    model_->refineIters = argData.flagArgumentInt(kRefineItersShort, 0, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+  }
+  // Solve the weights on representative frames and fit the transformations of all the frames
+  if (argData.isFlagSet(kFrameBudgetShort)) {
+    model_->frameBudget = argData.flagArgumentInt(kFrameBudgetShort, 0, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+  }
+  if (argData.isFlagSet(kCheckpointShort)) {
+    MString checkpointFile = argData.flagArgumentString(kCheckpointShort, 0, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    model_->checkpointFile = checkpointFile.asChar();
+  }
+  if (argData.isFlagSet(kCheckpointIntervalShort)) {
+    model_->checkpointInterval = argData.flagArgumentInt(kCheckpointIntervalShort, 0, &status);
     CHECK_MSTATUS_AND_RETURN_IT(status);
   }
 
-  if (argData.isFlagSet(kBonesShort) && model_.nB > 0) {
+  // A resumed solve keeps the bones of the checkpoint
+  if (argData.isFlagSet(kBonesShort) && model_->nB > 0 && !resume) {
     int boneCount = argData.flagArgumentInt(kBonesShort, 0, &status);
     CHECK_MSTATUS_AND_RETURN_IT(status);
-    model_.nB += boneCount;
+    model_->nB += boneCount;
   }
 
-  if (model_.nB == 0) {
+  if (model_->nB == 0) {
     if (!argData.isFlagSet(kBonesShort)) {
       MGlobal::displayError("No joints found. Need to set the number of bones (-b/-bones)");
       return MS::kInvalidParameter;
     }
 
-    model_.nB = argData.flagArgumentInt(kBonesShort, 0, &status);
+    model_->nB = argData.flagArgumentInt(kBonesShort, 0, &status);
+  }
+
+  if (argData.isFlagSet(kBackgroundShort)) {
+    // The model now holds a snapshot of everything the solve needs.  compute also initializes
+    // the bones so none of the solve runs on the main thread.
+    model_->showProgress = false;
+    int id = DemBonesJobQueue::instance().submit(pathMesh_, model_);
+    undoable_ = false;
+    setResult(id);
+    return MS::kSuccess;
+  }
+
+  model_->startSolve();
+  // A coarse-to-fine or frame budget solve initializes the bones on its reduced model
+  bool frameBudget = model_->frameBudget > 0 && model_->frameBudget < model_->nF;
+  if (model_->boneName.empty() && model_->multiResRatio >= 1.0 && !frameBudget) {
     std::cout << "Initializing bones: 1";
-    model_.init();
+    model_->init();
     std::cout << std::endl;
   }
 
   std::cout << "Computing Skinning Decomposition:\n";
-  if (!model_.compute()) {
+  StartProgress("Dem Bones", model_->solveIters());
+  auto solveStart = std::chrono::steady_clock::now();
+  bool success = model_->solve();
+  double solveSeconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - solveStart).count();
+  EndProgress();
+  if (success && frameBudget) {
+    MGlobal::displayInfo(MString("demBones solved the weights on ") + model_->frameBudget +
+                         " of " + model_->nF + " frames in " + solveSeconds + "s, RMSE over all "
+                         "frames " + model_->rmse() + ".");
+  }
+  model_->releaseVertices();
+  if (!success) {
     return MS::kFailure;
   }
+  if (model_->cancelled()) {
+    MGlobal::displayWarning("demBones cancelled, using the result of the last completed update.");
+  } else if (model_->timedOut()) {
+    MGlobal::displayWarning("demBones reached the -maxTime budget, using the result of the last "
+                            "completed update.");
+  } else if (model_->converged()) {
+    MGlobal::displayInfo(MString("demBones converged after ") + (model_->iter + 1) +
+                         " iterations.");
+  }
 
   return redoIt();
 }
 
-MStatus DemBonesCmd::readMeshSequence(double startFrame, double endFrame) {
+MStatus DemBonesCmd::doJobFlags(const MArgDatabase& argData, bool& handled) {
   MStatus status;
-  model_.nS = 1;
-  model_.nF = static_cast<int>(endFrame - startFrame + 1.0);
+  DemBonesJobQueue& queue = DemBonesJobQueue::instance();
+  handled = true;
+  undoable_ = false;
+  clearResult();
+
+  if (argData.isFlagSet(kListJobsShort)) {
+    std::vector<int> ids = queue.ids();
+    MIntArray result;
+    for (int id : ids) {
+      result.append(id);
+    }
+    setResult(result);
+    return MS::kSuccess;
+  }
+
+  const char* flag = nullptr;
+  if (argData.isFlagSet(kJobStatusShort)) {
+    flag = kJobStatusShort;
+  } else if (argData.isFlagSet(kJobProgressShort)) {
+    flag = kJobProgressShort;
+  } else if (argData.isFlagSet(kCancelJobShort)) {
+    flag = kCancelJobShort;
+  } else if (argData.isFlagSet(kCommitJobShort)) {
+    flag = kCommitJobShort;
+  } else if (argData.isFlagSet(kCommitFinishedShort)) {
+    flag = kCommitFinishedShort;
+  }
+  if (flag) {
+    int id = argData.flagArgumentInt(flag, 0, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    std::shared_ptr<DemBonesJob> job = queue.job(id);
+    if (flag == kCommitFinishedShort &&
+        (!job || job->status != DemBonesJob::kFinished)) {
+      // The job was committed or cancelled by hand before the idle commit ran
+      return MS::kSuccess;
+    }
+    if (!job) {
+      MGlobal::displayError(MString("No demBones job ") + id);
+      return MS::kInvalidParameter;
+    }
+    if (flag == kJobStatusShort) {
+      setResult(DemBonesJobQueue::statusName(job->status));
+    } else if (flag == kJobProgressShort) {
+      // [completed iterations, total iterations, rmse]
+      MDoubleArray result;
+      result.append(job->model->lastIter - job->model->iterStart);
+      result.append(job->model->solveIters());
+      result.append(job->model->lastRmse);
+      setResult(result);
+    } else if (flag == kCancelJobShort) {
+      queue.cancel(id);
+    } else {
+      undoable_ = true;
+      return commitJob(id);
+    }
+    return MS::kSuccess;
+  }
+
+  handled = false;
+  undoable_ = true;
+  return MS::kSuccess;
+}
+
+MStatus DemBonesCmd::commitJob(int id) {
+  std::shared_ptr<DemBonesJob> job = DemBonesJobQueue::instance().job(id);
+  if (job->status != DemBonesJob::kFinished) {
+    MGlobal::displayError(MString("demBones job ") + id + " is " +
+                          DemBonesJobQueue::statusName(job->status));
+    return MS::kFailure;
+  }
+  if (!job->pathMesh.isValid()) {
+    job->status = DemBonesJob::kFailed;
+    MGlobal::displayError(MString("demBones job ") + id +
+                          " failed, its mesh no longer exists.");
+    return MS::kFailure;
+  }
+  model_ = job->model;
+  pathMesh_ = job->pathMesh;
+  job->status = DemBonesJob::kCommitted;
+  DemBonesJobQueue::instance().remove(id);
+  if (model_->timedOut()) {
+    MGlobal::displayWarning(MString("demBones job ") + id +
+                            " reached the -maxTime budget, using the result of the last "
+                            "completed update.");
+  }
+  return redoIt();
+}
+
+MStatus DemBonesCmd::readMeshSequence(const std::vector<double>& startFrames,
+                                      const std::vector<double>& endFrames,
+                                      const std::vector<std::unique_ptr<PointCache>>& caches) {
+  MStatus status;
+  model_->nS = static_cast<int>(startFrames.size());
+  model_->fStart.resize(model_->nS + 1);
+  model_->fStart(0) = 0;
+  for (int s = 0; s < model_->nS; ++s) {
+    model_->fStart(s + 1) =
+        model_->fStart(s) + static_cast<int>(endFrames[s] - startFrames[s] + 1.0);
+  }
+  model_->nF = model_->fStart(model_->nS);
+  model_->subjectID.resize(model_->nF);
+  for (int s = 0; s < model_->nS; s++) {
+    for (int k = model_->fStart(s); k < model_->fStart(s + 1); k++) {
+      model_->subjectID(k) = s;
+    }
+  }
 
   MFnMesh fnMesh(pathMesh_, &status);
   CHECK_MSTATUS_AND_RETURN_IT(status);
-  model_.nV = fnMesh.numVertices();
-  model_.v.resize(3 * model_.nF, model_.nV);
-  model_.fTime.resize(model_.nF);
-  model_.fStart.resize(model_.nS + 1);
-  model_.fStart(0) = 0;
-  model_.nB = pathBones_.length();
-  model_.m.resize(model_.nF * 4, model_.nB * 4);
-
-  int frameCount = static_cast<int>(endFrame - startFrame + 1);
+  model_->nV = fnMesh.numVertices();
+  status = allocateVertices();
+  CHECK_MSTATUS_AND_RETURN_IT(status);
+  model_->fTime.resize(model_->nF);
+  model_->nB = pathBones_.length();
+  model_->m.resize(model_->nF * 4, model_->nB * 4);
+
+  // Frames are sampled by evaluating the world space plugs in a DG context so global time is
+  // never changed and only the upstream graph of the mesh and bones is evaluated
+  MPlug plugMesh;
+  status = getWorldPlug(pathMesh_, "worldMesh", plugMesh);
+  CHECK_MSTATUS_AND_RETURN_IT(status);
+  std::vector<MPlug> plugBones(model_->nB);
+  for (int j = 0; j < model_->nB; ++j) {
+    status = getWorldPlug(pathBones_[j], "worldMatrix", plugBones[j]);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+  }
 
   // Get bone info
-  MTime time = MAnimControl::currentTime();
-  time.setValue(0.0);
-  status = MAnimControl::setCurrentTime(time);
-  CHECK_MSTATUS_AND_RETURN_IT(status);
-  model_.boneName.resize(model_.nB);
-  for (unsigned int i = 0; i < model_.nB; ++i) {
-    model_.boneName[i] = pathBones_[i].partialPathName().asChar();
+  model_->boneName.resize(model_->nB);
+  for (unsigned int i = 0; i < model_->nB; ++i) {
+    model_->boneName[i] = pathBones_[i].partialPathName().asChar();
   }
 
-  model_.parent.resize(model_.nB);
-  model_.bind.resize(model_.nS * 4, model_.nB * 4);
-  model_.preMulInv.resize(model_.nS * 4, model_.nB * 4);
-  model_.rotOrder.resize(model_.nS * 3, model_.nB);
+  model_->parent.resize(model_->nB);
+  model_->bind.resize(model_->nS * 4, model_->nB * 4);
+  model_->preMulInv.resize(model_->nS * 4, model_->nB * 4);
+  model_->rotOrder.resize(model_->nS * 3, model_->nB);
   int s = 0;
 
-  for (int j = 0; j < model_.nB; j++) {
-    std::string nj = model_.boneName[j];
+  for (int j = 0; j < model_->nB; j++) {
+    std::string nj = model_->boneName[j];
 
-    model_.parent(j) = -1;
+    model_->parent(j) = -1;
     MDagPath parent(pathBones_[j]);
     status = parent.pop();
     if (!MFAIL(status)) {
-      for (int k = 0; k < model_.nB; k++) {
-        if (model_.boneName[k] == parent.partialPathName().asChar()) {
-          model_.parent(j) = k;
+      for (int k = 0; k < model_->nB; k++) {
+        if (model_->boneName[k] == parent.partialPathName().asChar()) {
+          model_->parent(j) = k;
         }
       }
     }
 
-    model_.bind.blk4(s, j) = toMatrix4d(pathBones_[j].inclusiveMatrix());
+    // Assume the bind pose is on frame 0
+    MMatrix bind;
+    status = evaluateMatrix(plugBones[j], 0.0, bind);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    model_->bind.blk4(s, j) = toMatrix4d(bind);
 
     MFnTransform fnTransform(pathBones_[j], &status);
     CHECK_MSTATUS_AND_RETURN_IT(status);
@@ -252,22 +677,22 @@ MStatus DemBonesCmd::readMeshSequence(double startFrame, double endFrame) {
     fnTransform.getRotation(rotation);
     switch (rotation.order) {
       case MEulerRotation::kXYZ:
-        model_.rotOrder.vec3(s, j) = Eigen::Vector3i(0, 1, 2);
+        model_->rotOrder.vec3(s, j) = Eigen::Vector3i(0, 1, 2);
         break;
       case MEulerRotation::kYZX:
-        model_.rotOrder.vec3(s, j) = Eigen::Vector3i(1, 2, 0);
+        model_->rotOrder.vec3(s, j) = Eigen::Vector3i(1, 2, 0);
         break;
       case MEulerRotation::kZXY:
-        model_.rotOrder.vec3(s, j) = Eigen::Vector3i(2, 0, 1);
+        model_->rotOrder.vec3(s, j) = Eigen::Vector3i(2, 0, 1);
         break;
       case MEulerRotation::kXZY:
-        model_.rotOrder.vec3(s, j) = Eigen::Vector3i(0, 2, 1);
+        model_->rotOrder.vec3(s, j) = Eigen::Vector3i(0, 2, 1);
         break;
       case MEulerRotation::kYXZ:
-        model_.rotOrder.vec3(s, j) = Eigen::Vector3i(1, 0, 2);
+        model_->rotOrder.vec3(s, j) = Eigen::Vector3i(1, 0, 2);
         break;
       case MEulerRotation::kZYX:
-        model_.rotOrder.vec3(s, j) = Eigen::Vector3i(2, 1, 0);
+        model_->rotOrder.vec3(s, j) = Eigen::Vector3i(2, 1, 0);
         break;
     }
 
@@ -281,157 +706,381 @@ MStatus DemBonesCmd::readMeshSequence(double startFrame, double endFrame) {
       Matrix4d gjp = Map<Matrix4d>((double*)(jn[j].pParentJoint->EvaluateGlobalTransform()));
       preMulInv =  gp.inverse() * gjp;
     }*/
-    model_.preMulInv.blk4(s, j) = toMatrix4d(preMulInv);
-
-  }
+    model_->preMulInv.blk4(s, j) = toMatrix4d(preMulInv);
 
-  // TODO: Use existing bone weight
-  Eigen::MatrixXd wd(0, 0);
-  /*if (importer.wT.size() != 0) {
-    wd = MatrixXd::Zero(model.nB, model.nV);
-    for (int j = 0; j < model.nB; j++){
-      wd.row(j) = importer.wT[model.boneName[j]].transpose();
+    // All the subjects share the bind pose
+    for (int k = 1; k < model_->nS; ++k) {
+      model_->bind.blk4(k, j) = model_->bind.blk4(s, j);
+      model_->preMulInv.blk4(k, j) = model_->preMulInv.blk4(s, j);
+      model_->rotOrder.vec3(k, j) = model_->rotOrder.vec3(s, j);
     }
-  }*/
+  }
 
-  model_.w = (wd / model_.nS).sparseView(1, 1e-20);
+  // Start from the current skinning when the mesh is already skinned to the existing bones
+  model_->w.resize(0, 0);
+  status = readSkinWeights();
+  CHECK_MSTATUS_AND_RETURN_IT(status);
   bool hasKeyFrame = true;
   if (!hasKeyFrame) {
-    model_.m.resize(0, 0);
+    model_->m.resize(0, 0);
   }
 
 
-  for (int s = 0; s < model_.nS; s++) {
-    int start = model_.fStart(s);
-    // Read vertex data each frame
-    for (int f = 0; f < model_.nF; ++f) {
-      double frame = startFrame + static_cast<double>(f);
-      time.setValue(frame);
-      status = MAnimControl::setCurrentTime(time);
-      CHECK_MSTATUS_AND_RETURN_IT(status);
-      model_.fTime(start + f) = frame;
-      MPointArray points;
-      fnMesh.getPoints(points, MSpace::kWorld);
+  if (!caches.empty()) {
+    readPointCaches(caches);
+  }
+  // Scene evaluation has to stay on the main thread, only the caches are read in parallel
+  for (int s = 0; s < model_->nS; s++) {
+    int start = model_->fStart(s);
+    for (int f = 0; f < model_->fStart(s + 1) - start; ++f) {
+      double frame = startFrames[s] + static_cast<double>(f);
+      model_->fTime(start + f) = frame;
+
+      if (caches.empty()) {
+        // Read vertex data each frame directly from the mesh data in to the model
+        MObject oMesh;
+        status = evaluatePlug(plugMesh, frame, oMesh);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+        MFnMesh fnMeshData(oMesh, &status);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+        const float* points = fnMeshData.getRawPoints(&status);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+        model_->v.block((start + f) * 3, 0, 3, model_->nV) =
+            Eigen::Map<const Eigen::Matrix3Xf>(points, 3, model_->nV);
+      }
 
-#pragma omp parallel for
-      for (int i = 0; i < model_.nV; i++) {
-        model_.v.col(i).segment<3>((start + f) * 3) << points[i].x, points[i].y, points[i].z;
+      for (int j = 0; j < model_->nB; ++j) {
+        MMatrix world;
+        status = evaluateMatrix(plugBones[j], frame, world);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+        model_->m.blk4(start + f, j) = toMatrix4d(world) * model_->bind.blk4(s, j).inverse();
       }
+    }
+  }
+
+  model_->origM = model_->m;
+
+  return MS::kSuccess;
+}
 
-      for (int j = 0; j < model_.nB; ++j) {
-        model_.m.blk4(f, j) = toMatrix4d(pathBones_[j].inclusiveMatrix()) * model_.bind.blk4(s, j).inverse();
+MStatus DemBonesCmd::readSkinWeights() {
+  MStatus status;
+  MObject oMesh = pathMesh_.node();
+  MItDependencyGraph itGraph(oMesh, MFn::kSkinClusterFilter, MItDependencyGraph::kUpstream,
+                             MItDependencyGraph::kDepthFirst, MItDependencyGraph::kNodeLevel,
+                             &status);
+  CHECK_MSTATUS_AND_RETURN_IT(status);
+  if (itGraph.isDone() || model_->nB == 0) {
+    return MS::kSuccess;
+  }
+  MFnSkinCluster fnSkin(itGraph.currentItem(), &status);
+  CHECK_MSTATUS_AND_RETURN_IT(status);
+
+  // Map the skinCluster influences to the model bones, other influences are dropped
+  MDagPathArray influences;
+  unsigned int influenceCount = fnSkin.influenceObjects(influences, &status);
+  CHECK_MSTATUS_AND_RETURN_IT(status);
+  std::vector<int> boneIndex(influenceCount, -1);
+  bool hasBone = false;
+  for (unsigned int k = 0; k < influenceCount; ++k) {
+    for (unsigned int j = 0; j < pathBones_.length(); ++j) {
+      if (influences[k] == pathBones_[j]) {
+        boneIndex[k] = j;
+        hasBone = true;
       }
     }
-    model_.fStart(s + 1) = model_.fStart(s) + model_.nF;
+  }
+  if (!hasBone) {
+    MGlobal::displayWarning(fnSkin.name() + " has none of the existing bones as influences, "
+                            "starting without weights.");
+    return MS::kSuccess;
+  }
+  if (addBones_) {
+    // Weights over only some of the bones would make the solve skip initializing the new ones
+    MGlobal::displayWarning("demBones is adding bones, starting without the weights of " +
+                            fnSkin.name() + ".");
+    return MS::kSuccess;
   }
 
-  model_.origM = model_.m;
+  MFnSingleIndexedComponent fnComponent;
+  MObject oComponents = fnComponent.create(MFn::kMeshVertComponent, &status);
+  CHECK_MSTATUS_AND_RETURN_IT(status);
+  status = fnComponent.setCompleteData(model_->nV);
+  CHECK_MSTATUS_AND_RETURN_IT(status);
+  MDoubleArray weights;
+  status = fnSkin.getWeights(pathMesh_, oComponents, weights, influenceCount);
+  CHECK_MSTATUS_AND_RETURN_IT(status);
 
-  model_.subjectID.resize(model_.nF);
-  for (int s = 0; s < model_.nS; s++) {
-    for (int k = model_.fStart(s); k < model_.fStart(s + 1); k++) {
-      model_.subjectID(k) = s;
+  std::vector<Eigen::Triplet<double>> triplets;
+  for (int i = 0; i < model_->nV; ++i) {
+    // Renormalize over the mapped influences
+    double sum = 0.0;
+    size_t first = triplets.size();
+    for (unsigned int k = 0; k < influenceCount; ++k) {
+      double weight = weights[i * influenceCount + k];
+      if (boneIndex[k] != -1 && weight > 0.0) {
+        triplets.push_back(Eigen::Triplet<double>(boneIndex[k], i, weight));
+        sum += weight;
+      }
+    }
+    for (size_t t = first; t < triplets.size(); ++t) {
+      triplets[t] = Eigen::Triplet<double>(triplets[t].row(), i, triplets[t].value() / sum);
     }
   }
+  model_->w.resize(model_->nB, model_->nV);
+  model_->w.setFromTriplets(triplets.begin(), triplets.end());
+  MGlobal::displayInfo("demBones starting from the weights of " + fnSkin.name());
+  return MS::kSuccess;
+}
 
+MStatus DemBonesCmd::readCachedSequence(
+    const std::vector<std::unique_ptr<PointCache>>& caches) {
+  bool match = static_cast<int>(caches.size()) == model_->nS;
+  for (int s = 0; match && s < model_->nS; ++s) {
+    match = caches[s]->frameCount() ==
+            static_cast<unsigned int>(model_->fStart(s + 1) - model_->fStart(s));
+  }
+  if (!match) {
+    MGlobal::displayError("The point caches do not match the subjects of the checkpoint");
+    return MS::kInvalidParameter;
+  }
+  MStatus status = allocateVertices();
+  CHECK_MSTATUS_AND_RETURN_IT(status);
+  readPointCaches(caches);
   return MS::kSuccess;
 }
 
-MStatus DemBonesCmd::readBindPose() {
+MStatus DemBonesCmd::loadCheckpoint(const MString& path) {
   MStatus status;
-  MTime time = MAnimControl::currentTime();
-  time.setValue(0.0);
-  status = MAnimControl::setCurrentTime(time);
+  Eigen::VectorXi fStart = model_->fStart;
+  int iteration;
+  std::string error;
+  if (!DemBonesCheckpoint::load(path.asChar(), *model_, iteration, error)) {
+    MGlobal::displayError(error.c_str());
+    return MS::kFailure;
+  }
+  MFnMesh fnMesh(pathMesh_, &status);
   CHECK_MSTATUS_AND_RETURN_IT(status);
+  // The frames read from the scene must split in to the same subjects as the checkpoint
+  bool frameMismatch = fStart.size() && (fStart.size() != model_->fStart.size() ||
+                                         fStart != model_->fStart);
+  if (model_->nV != fnMesh.numVertices() || frameMismatch) {
+    MGlobal::displayError(path + " does not match the vertex and frame counts of " +
+                          pathMesh_.partialPathName());
+    return MS::kInvalidParameter;
+  }
+  model_->iterStart = iteration;
+  return MS::kSuccess;
+}
 
+MStatus DemBonesCmd::allocateVertices() {
+  int rows = 3 * model_->nF;
+  if (scratchFile_.length() == 0) {
+    model_->resizeV(rows, model_->nV);
+    return MS::kSuccess;
+  }
+  std::string error;
+  if (!model_->mapScratchFile(scratchFile_.asChar(), rows, model_->nV, error)) {
+    MGlobal::displayError(error.c_str());
+    return MS::kFailure;
+  }
+  return MS::kSuccess;
+}
+
+void DemBonesCmd::readPointCaches(const std::vector<std::unique_ptr<PointCache>>& caches) {
+  int frameCount = model_->nF;
+  int vertexCount = model_->nV;
+  // The frames of all the subjects are handed out in contiguous chunks so neighbouring threads
+  // rarely write to the same cache line of a model_->v column
+#pragma omp parallel for schedule(static, 16)
+  for (int f = 0; f < frameCount; ++f) {
+    int s = model_->subjectID(f);
+    const float* points = caches[s]->frame(f - model_->fStart(s));
+    int row = f * 3;
+    for (int i = 0; i < vertexCount; ++i) {
+      model_->v.col(i).segment<3>(row) << points[i * 3], points[i * 3 + 1], points[i * 3 + 2];
+    }
+  }
+}
+
+MStatus DemBonesCmd::readBindPose() {
+  MStatus status;
   MFnMesh fnMesh(pathMesh_, &status);
   CHECK_MSTATUS_AND_RETURN_IT(status);
-  MPointArray points;
-  fnMesh.getPoints(points, MSpace::kWorld);
 
-  model_.u.resize(model_.nS * 3, model_.nV);
-  Eigen::MatrixXd v;
-  v.resize(3, fnMesh.numVertices());
-  for (int i = 0; i < model_.nV; i++) {
-    v.col(i) << points[i].x, points[i].y, points[i].z;
-  }
+  // Assume the bind pose is on frame 0
+  MPlug plugMesh;
+  status = getWorldPlug(pathMesh_, "worldMesh", plugMesh);
+  CHECK_MSTATUS_AND_RETURN_IT(status);
+  MObject oMesh;
+  status = evaluatePlug(plugMesh, 0.0, oMesh);
+  CHECK_MSTATUS_AND_RETURN_IT(status);
+  MFnMesh fnMeshData(oMesh, &status);
+  CHECK_MSTATUS_AND_RETURN_IT(status);
+  const float* points = fnMeshData.getRawPoints(&status);
+  CHECK_MSTATUS_AND_RETURN_IT(status);
 
-  model_.u.block(0, 0, 3, model_.nV) = v;
+  model_->u.resize(model_->nS * 3, model_->nV);
+  model_->u.block(0, 0, 3, model_->nV) =
+      Eigen::Map<const Eigen::Matrix3Xf>(points, 3, model_->nV).cast<double>();
+  for (int s = 1; s < model_->nS; ++s) {
+    model_->u.middleRows(s * 3, 3) = model_->u.topRows(3);
+  }
 
   int numPolygons = fnMesh.numPolygons();
-  model_.fv.resize(numPolygons);
+  model_->fv.resize(numPolygons);
   for (int i = 0; i < numPolygons; i++) {
     MIntArray vertexList;
     fnMesh.getPolygonVertices(i, vertexList);
-    model_.fv[i].resize(vertexList.length());
-    for (unsigned int j = 0; j < model_.fv[i].size(); ++j) {
-      model_.fv[i][j] = vertexList[j];
+    model_->fv[i].resize(vertexList.length());
+    for (unsigned int j = 0; j < model_->fv[i].size(); ++j) {
+      model_->fv[i][j] = vertexList[j];
     }
   }
 
   return MS::kSuccess;
 }
 
+MStatus DemBonesCmd::getWorldPlug(const MDagPath& path, const MString& attribute, MPlug& plug) {
+  MStatus status;
+  MFnDagNode fnNode(path, &status);
+  CHECK_MSTATUS_AND_RETURN_IT(status);
+  MPlug plugArray = fnNode.findPlug(attribute, false, &status);
+  CHECK_MSTATUS_AND_RETURN_IT(status);
+  plug = plugArray.elementByLogicalIndex(path.instanceNumber(), &status);
+  CHECK_MSTATUS_AND_RETURN_IT(status);
+  return MS::kSuccess;
+}
+
+MStatus DemBonesCmd::evaluatePlug(const MPlug& plug, double frame, MObject& oData) {
+  MStatus status;
+  MDGContext context(MTime(frame, MTime::uiUnit()));
+#if MAYA_API_VERSION >= 20190000
+  MDGContextGuard guard(context);
+  oData = plug.asMObject(&status);
+#else
+  oData = plug.asMObject(context, &status);
+#endif
+  CHECK_MSTATUS_AND_RETURN_IT(status);
+  return MS::kSuccess;
+}
+
+MStatus DemBonesCmd::evaluateMatrix(const MPlug& plug, double frame, MMatrix& matrix) {
+  MStatus status;
+  MObject oData;
+  status = evaluatePlug(plug, frame, oData);
+  CHECK_MSTATUS_AND_RETURN_IT(status);
+  MFnMatrixData fnData(oData, &status);
+  CHECK_MSTATUS_AND_RETURN_IT(status);
+  matrix = fnData.matrix(&status);
+  CHECK_MSTATUS_AND_RETURN_IT(status);
+  return MS::kSuccess;
+}
+
 MStatus DemBonesCmd::redoIt() {
   MStatus status;
   clearResult();
 
-  bool needCreateJoints = (model_.boneName.size() != model_.nB);
+  bool needCreateJoints = (model_->boneName.size() != model_->nB);
   std::vector<std::string> newBoneNames;
   MStringArray joints;
 
   if (needCreateJoints) {
     // model.boneName.resize(model.nB);
-    int creationCount = model_.nB - static_cast<int>(model_.boneName.size());
+    int creationCount = model_->nB - static_cast<int>(model_->boneName.size());
     for (int j = 0; j < creationCount; j++) {
       std::ostringstream s;
       s << "dembones_joint" << j;
-      model_.boneName.push_back(s.str());
+      model_->boneName.push_back(s.str());
       newBoneNames.push_back(s.str());
       joints.append(s.str().c_str());
     }
   }
-  for (int s = 0; s < model_.nS; ++s) {
-    Eigen::MatrixXd lr, lt, gb, lbr, lbt;
-    model_.computeRTB(s, lr, lt, gb, lbr, lbt, false);
+  for (int j = 0; j < newBoneNames.size(); ++j) {
+    MString name(newBoneNames[j].c_str());
+    MString cmd("createNode \"joint\" -n \"" + name + "\"");
+    MGlobal::executeCommand(cmd);
+  }
+  int startJointIdx = newBoneNames.size() == 0 ? 0 : model_->boneName.size() - newBoneNames.size();
+  int jointCount = static_cast<int>(model_->boneName.size()) - startJointIdx;
+
+  // The tolerance is given in degrees and ui linear units, the curves are keyed in internal units
+  double rotateTolerance = MAngle(keyTolerance_, MAngle::kDegrees).asRadians();
+  double translateTolerance = MDistance(keyTolerance_, MDistance::uiUnit()).asCentimeters();
+  Eigen::VectorXd tolerance(jointCount * 6);
+  for (int j = 0; j < jointCount; ++j) {
+    tolerance.segment<3>(j * 6).setConstant(rotateTolerance);
+    tolerance.segment<3>(j * 6 + 3).setConstant(translateTolerance);
+  }
 
-    Eigen::VectorXd val;
-    for (int j = 0; j < newBoneNames.size(); ++j) {
-      MString name(newBoneNames[j].c_str());
-      MString cmd("createNode \"joint\" -n \"" + name + "\"");
-      MGlobal::executeCommand(cmd);
+  // One column per keyed channel in the order of attributes for each subject
+  static const char* attributes[6] = {"rx", "ry", "rz", "tx", "ty", "tz"};
+  std::vector<Eigen::MatrixXd> samples(model_->nS);
+  std::vector<std::vector<KeyReducer::Curve>> curves(model_->nS);
+  Eigen::MatrixXd gb;
+  int frameKeyCount = 0;
+  int keyCount = 0;
+  for (int s = 0; s < model_->nS; ++s) {
+    Eigen::MatrixXd lr, lt, lbr, lbt;
+    model_->computeRTB(s, lr, lt, gb, lbr, lbt, false);
+
+    int nFs = model_->fStart(s + 1) - model_->fStart(s);
+    samples[s].resize(nFs, jointCount * 6);
+    for (int j = 0; j < jointCount; ++j) {
+      for (int c = 0; c < 3; ++c) {
+        samples[s].col(j * 6 + c) = Eigen::Map<const Eigen::VectorXd, 0, Eigen::InnerStride<3>>(
+            lr.col(startJointIdx + j).data() + c, nFs);
+        samples[s].col(j * 6 + 3 + c) =
+            Eigen::Map<const Eigen::VectorXd, 0, Eigen::InnerStride<3>>(
+                lt.col(startJointIdx + j).data() + c, nFs);
+      }
     }
-    int startJointIdx = newBoneNames.size() == 0 ? 0 : model_.boneName.size() - newBoneNames.size();
-    for (int j = startJointIdx; j < model_.boneName.size(); ++j) {
-      MDagPath pathJoint;
-      status = getDagPath(model_.boneName[j].c_str(), pathJoint);
-      CHECK_MSTATUS_AND_RETURN_IT(status);
+    frameKeyCount += static_cast<int>(samples[s].size());
+    if (keyTolerance_ > 0.0) {
+      Eigen::VectorXd fTime = model_->fTime.segment(model_->fStart(s), nFs);
+      keyCount += KeyReducer::reduce(fTime, samples[s], tolerance, curves[s]);
+    }
+  }
+  if (keyTolerance_ > 0.0) {
+    MGlobal::displayInfo(MString("demBones reduced ") + frameKeyCount + " keys to " + keyCount +
+                         ".");
+  }
 
-      val = lr.col(j);
-      setKeyframes(
-          Eigen::Map<Eigen::VectorXd, 0, Eigen::InnerStride<3>>(val.data() + 0, val.size() / 3),
-          model_.fTime, pathJoint, "rx");
-      setKeyframes(
-          Eigen::Map<Eigen::VectorXd, 0, Eigen::InnerStride<3>>(val.data() + 1, val.size() / 3),
-          model_.fTime, pathJoint, "ry");
-      setKeyframes(
-          Eigen::Map<Eigen::VectorXd, 0, Eigen::InnerStride<3>>(val.data() + 2, val.size() / 3),
-          model_.fTime, pathJoint, "rz");
-
-      val = lt.col(j);
-      setKeyframes(
-          Eigen::Map<Eigen::VectorXd, 0, Eigen::InnerStride<3>>(val.data() + 0, val.size() / 3),
-          model_.fTime, pathJoint, "tx");
-      setKeyframes(
-          Eigen::Map<Eigen::VectorXd, 0, Eigen::InnerStride<3>>(val.data() + 1, val.size() / 3),
-          model_.fTime, pathJoint, "ty");
-      setKeyframes(
-          Eigen::Map<Eigen::VectorXd, 0, Eigen::InnerStride<3>>(val.data() + 2, val.size() / 3),
-          model_.fTime, pathJoint, "tz");
-    }
-    status = setSkinCluster(model_.boneName, model_.w, gb);
+  // The subjects are keyed on their own frames of the same curves
+  for (int j = 0; j < jointCount; ++j) {
+    MDagPath pathJoint;
+    status = getDagPath(model_->boneName[startJointIdx + j].c_str(), pathJoint);
     CHECK_MSTATUS_AND_RETURN_IT(status);
+    for (int c = 0; c < 6; ++c) {
+      int channel = j * 6 + c;
+      MTimeArray times;
+      MDoubleArray values;
+      MDoubleArray slopes;
+      for (int s = 0; s < model_->nS; ++s) {
+        int start = model_->fStart(s);
+        if (keyTolerance_ > 0.0) {
+          const KeyReducer::Curve& curve = curves[s][channel];
+          for (size_t k = 0; k < curve.keys.size(); ++k) {
+            times.append(MTime(model_->fTime(start + curve.keys[k]), MTime::uiUnit()));
+            values.append(samples[s](curve.keys[k], channel));
+            slopes.append(curve.slopes[k]);
+          }
+        } else {
+          for (int f = 0; f < samples[s].rows(); ++f) {
+            times.append(MTime(model_->fTime(start + f), MTime::uiUnit()));
+            values.append(samples[s](f, channel));
+          }
+        }
+      }
+      status = setKeyframes(times, values, keyTolerance_ > 0.0 ? &slopes : nullptr, pathJoint,
+                            attributes[c]);
+      CHECK_MSTATUS_AND_RETURN_IT(status);
+    }
   }
+
+  // The weights and bind pose are shared by all the subjects
+  status = setSkinCluster(model_->boneName, model_->w, gb);
+  CHECK_MSTATUS_AND_RETURN_IT(status);
   setResult(joints);
   /*status = dgMod_.doIt();
   CHECK_MSTATUS_AND_RETURN_IT(status);
@@ -441,11 +1090,10 @@ MStatus DemBonesCmd::redoIt() {
   return MS::kSuccess;
 }
 
-MStatus DemBonesCmd::setKeyframes(const Eigen::VectorXd& val, const Eigen::VectorXd& fTime,
-                                  const MDagPath& pathJoint, const MString& attributeName) {
+MStatus DemBonesCmd::setKeyframes(const MTimeArray& times, const MDoubleArray& values,
+                                  const MDoubleArray* slopes, const MDagPath& pathJoint,
+                                  const MString& attributeName) {
   MStatus status;
-  int idx = 0;
-  int nFr = (int)fTime.size();
   MFnDagNode fnNode(pathJoint, &status);
   CHECK_MSTATUS_AND_RETURN_IT(status);
   MPlug plug = fnNode.findPlug(attributeName, false, &status);
@@ -453,16 +1101,30 @@ MStatus DemBonesCmd::setKeyframes(const Eigen::VectorXd& val, const Eigen::Vecto
   MFnAnimCurve fnCurve;
   MObject oCurve = fnCurve.create(plug, nullptr, &status);
   CHECK_MSTATUS_AND_RETURN_IT(status);
-  MTime time;
-  MTimeArray timeArray(nFr, time);
-  MDoubleArray values(nFr);
-  for (int i = 0; i < nFr; ++i) {
-    timeArray[i].setValue(fTime(i));
-    values[i] = val(i);
+  MTimeArray timeArray(times);
+  MDoubleArray valueArray(values);
+  if (!slopes) {
+    status = fnCurve.addKeys(&timeArray, &valueArray);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    return MS::kSuccess;
   }
-  status = fnCurve.addKeys(&timeArray, &values);
-  CHECK_MSTATUS_AND_RETURN_IT(status);
 
+  status = fnCurve.addKeys(&timeArray, &valueArray, MFnAnimCurve::kTangentFixed,
+                           MFnAnimCurve::kTangentFixed);
+  CHECK_MSTATUS_AND_RETURN_IT(status);
+  // Unconverted tangents are in seconds and internal units while the slopes are per frame.
+  // Keys are looked up by time as subjects with overlapping frames replace each other's keys.
+  double secondsPerFrame = MTime(1.0, MTime::uiUnit()).as(MTime::kSeconds);
+  for (unsigned int i = 0; i < times.length(); ++i) {
+    unsigned int index;
+    if (!fnCurve.find(times[i], index)) {
+      continue;
+    }
+    status = fnCurve.setTangent(index, secondsPerFrame, (*slopes)[i], true, nullptr, false);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    status = fnCurve.setTangent(index, secondsPerFrame, (*slopes)[i], false, nullptr, false);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+  }
   return MS::kSuccess;
 }
 
@@ -478,44 +1140,95 @@ MStatus DemBonesCmd::setSkinCluster(const std::vector<std::string>& name,
 
   // Skin a duplicate of the mesh
   MStringArray duplicate;
-  MGlobal::executeCommand("duplicate -rr " + pathMesh_.partialPathName(), duplicate);
-
-  MString cmd("skinCluster -tsb");
-  Eigen::SparseMatrix<double> wT = w.transpose();
-  int nB = (int)name.size();
-  MFnMesh fnMesh(pathMesh_, &status);
+  status = MGlobal::executeCommand("duplicate -rr " + pathMesh_.partialPathName(), duplicate);
   CHECK_MSTATUS_AND_RETURN_IT(status);
-  MDoubleArray weights(fnMesh.numVertices() * nB);
-  MIntArray influenceIndices;
-  for (int i = 0; i < nB; ++i) {
-    influenceIndices.append(i);
-    cmd += MString(" ") + name[i].c_str();
-    for (Eigen::SparseMatrix<double>::InnerIterator it(wT, i); it; ++it) {
-      weights[(int)it.row() * nB + i] = it.value();
-    }
+  if (duplicate.length() == 0) {
+    MGlobal::displayError("Unable to duplicate " + pathMesh_.partialPathName());
+    return MS::kFailure;
   }
 
-  cmd += " " + duplicate[0];
+  // skinCluster binds the selected joints and geometry.  Each vertex starts with a single
+  // influence so the default weights are cheap to replace.
+  int nB = (int)name.size();
+  MSelectionList bindList;
+  for (int j = 0; j < nB; ++j) {
+    status = bindList.add(name[j].c_str());
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+  }
+  status = bindList.add(duplicate[0]);
+  CHECK_MSTATUS_AND_RETURN_IT(status);
+  MSelectionList activeList;
+  MGlobal::getActiveSelectionList(activeList);
+  MGlobal::setActiveSelectionList(bindList);
   MStringArray result;
-  MGlobal::executeCommand(cmd, result);
+  status = MGlobal::executeCommand("skinCluster -tsb -mi 1", result);
+  MGlobal::setActiveSelectionList(activeList);
+  CHECK_MSTATUS_AND_RETURN_IT(status);
 
   MObject oSkin;
   status = getDependNode(result[0], oSkin);
   CHECK_MSTATUS_AND_RETURN_IT(status);
-
   MFnSkinCluster fnSkin(oSkin, &status);
   CHECK_MSTATUS_AND_RETURN_IT(status);
 
-  MObject oSet = fnSkin.deformerSet();
-  MFnSet fnSet(oSet, &status);
+  std::vector<unsigned int> influenceIndex(nB);
+  for (int j = 0; j < nB; ++j) {
+    MDagPath pathJoint;
+    status = bindList.getDagPath(j, pathJoint);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    influenceIndex[j] = fnSkin.indexForInfluenceObject(pathJoint, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+  }
+
+  // Write the nonzero weights of each vertex through the weightList plugs and remove the bind
+  // weights they do not overwrite.  Removals are batched in vertex chunks.
+  MPlug plugWeightList = fnSkin.findPlug("weightList", false, &status);
   CHECK_MSTATUS_AND_RETURN_IT(status);
-  MSelectionList members;
-  fnSet.getMembers(members, false);
-  MDagPath path;
-  MObject components;
-  members.getDagPath(0, path, components);
+  MPlug plugWeights = fnSkin.findPlug("weights", false, &status);
+  CHECK_MSTATUS_AND_RETURN_IT(status);
+  MObject oWeights = plugWeights.attribute();
+  const int chunkSize = 4096;
+  int nV = (int)w.cols();
+  std::vector<char> written(nB, 0);
+  std::vector<int> boneForInfluence;
+  for (int j = 0; j < nB; ++j) {
+    if (influenceIndex[j] >= boneForInfluence.size()) {
+      boneForInfluence.resize(influenceIndex[j] + 1, -1);
+    }
+    boneForInfluence[influenceIndex[j]] = j;
+  }
+  for (int start = 0; start < nV; start += chunkSize) {
+    MDGModifier dgMod;
+    int end = std::min(start + chunkSize, nV);
+    for (int i = start; i < end; ++i) {
+      MPlug plugVertex = plugWeightList.elementByLogicalIndex(i, &status).child(oWeights, &status);
+      CHECK_MSTATUS_AND_RETURN_IT(status);
+      for (Eigen::SparseMatrix<double>::InnerIterator it(w, i); it; ++it) {
+        status = plugVertex.elementByLogicalIndex(influenceIndex[it.row()]).setDouble(it.value());
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+        written[it.row()] = 1;
+      }
+      MIntArray existing;
+      plugVertex.getExistingArrayAttributeIndices(existing);
+      for (unsigned int k = 0; k < existing.length(); ++k) {
+        int j = existing[k] < (int)boneForInfluence.size() ? boneForInfluence[existing[k]] : -1;
+        if (j == -1 || !written[j]) {
+          dgMod.removeMultiInstance(plugVertex.elementByLogicalIndex(existing[k]), true);
+        }
+      }
+      for (Eigen::SparseMatrix<double>::InnerIterator it(w, i); it; ++it) {
+        written[it.row()] = 0;
+      }
+    }
+    status = dgMod.doIt();
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+  }
 
-  fnSkin.setWeights(path, components, influenceIndices, weights, true);
+  // The skinCluster was created with a single influence, cap it at the solved sparsity instead
+  MPlug plugMaxInfluences = fnSkin.findPlug("maxInfluences", false, &status);
+  CHECK_MSTATUS_AND_RETURN_IT(status);
+  status = plugMaxInfluences.setInt(model_->nnz);
+  CHECK_MSTATUS_AND_RETURN_IT(status);
 
   return MS::kSuccess;
 }
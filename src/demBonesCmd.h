@@ -2,27 +2,195 @@
 #define CMT_DEMBONESCMD_H
 
 #include "DemBones/DemBonesExt.h"
+#include "common.h"
+#include "demBonesCheckpoint.h"
+#include "keyReducer.h"
+#include "memoryMappedFile.h"
+#include "pointCache.h"
 
 #include <maya/MArgDatabase.h>
 #include <maya/MArgList.h>
 #include <maya/MDGModifier.h>
 #include <maya/MDagPath.h>
 #include <maya/MDagPathArray.h>
+#include <maya/MDoubleArray.h>
 #include <maya/MGlobal.h>
 #include <maya/MObject.h>
+#include <maya/MPlug.h>
 #include <maya/MPxCommand.h>
 #include <maya/MSelectionList.h>
 #include <maya/MSyntax.h>
+#include <maya/MTimeArray.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
 #include <iostream>
+#include <memory>
+#include <vector>
 
 using namespace Dem;
 
 class MyDemBones : public DemBonesExt<double, float> {
  public:
+  MyDemBones()
+      : tolerance(0.0),
+        patience(3),
+        maxTime(0.0),
+        showProgress(true),
+        multiResRatio(1.0),
+        refineIters(2),
+        frameBudget(0),
+        checkpointInterval(5),
+        cancelRequested(false),
+        lastIter(0),
+        lastRmse(0.0),
+        solveVertexCount_(0),
+        solveFrameCount_(0) {
+    startSolve();
+  }
+
+  ~MyDemBones() { releaseVertices(); }
+
+  //! Relative RMSE improvement per iteration below which the solve is converged, 0 to disable
+  double tolerance;
+  //! Number of consecutive converged iterations before the solve stops
+  int patience;
+  //! Time budget of the solve in seconds, 0 for no limit
+  double maxTime;
+  //! Whether to drive the Maya main progress bar and check it for cancellation
+  bool showProgress;
+  //! Fraction of the vertices solved before refining at full resolution, 1 to disable
+  double multiResRatio;
+  //! Number of full resolution iterations after a coarse solve
+  int refineIters;
+  //! Number of representative frames the weights are solved on, 0 to solve all the frames
+  int frameBudget;
+  //! File the solve state is written to during and after the solve, empty to disable
+  std::string checkpointFile;
+  //! Number of global iterations between checkpoints
+  int checkpointInterval;
+  //! Set from another thread to stop the solve after the current update
+  std::atomic<bool> cancelRequested;
+  //! Number of completed iterations, readable from other threads while solving
+  std::atomic<int> lastIter;
+  //! RMSE of the last completed iteration, readable from other threads while solving
+  std::atomic<double> lastRmse;
+
+  /**
+    Resets the convergence and time budget state.  Call before init/compute.
+  */
+  void startSolve() {
+    prevRmse_ = -1.0;
+    convergedIters_ = 0;
+    cancelled_ = false;
+    timedOut_ = false;
+    converged_ = false;
+    lastIter = iterStart;
+    lastRmse = 0.0;
+    start_ = std::chrono::steady_clock::now();
+  }
+
+  /**
+    Maps the animated vertex matrix to a new scratch file that is deleted on release.
+    @param[in] path Path of the scratch file.
+    @param[in] rows Number of rows of v.
+    @param[in] cols Number of columns of v.
+    @param[out] error Description of the failure.
+  */
+  bool mapScratchFile(const std::string& path, int rows, int cols, std::string& error) {
+    size_t size = sizeof(float) * static_cast<size_t>(rows) * cols;
+    if (!scratch_.create(path, size, error)) {
+      return false;
+    }
+    scratchPath_ = path;
+    mapV(reinterpret_cast<float*>(scratch_.data()), rows, cols);
+    return true;
+  }
+
+  /**
+    Releases the animated vertex matrix and deletes the scratch file once the decomposition
+    no longer needs it.
+  */
+  void releaseVertices() {
+    mapV(nullptr, 0, 0);
+    if (scratch_.isOpen()) {
+      scratch_.close();
+      std::remove(scratchPath_.c_str());
+    }
+  }
+
+  /**
+    Runs the decomposition, coarse-to-fine when multiResRatio is below 1 and on a subset of the
+    frames when frameBudget is set.
+  */
+  bool solve() {
+    solveVertexCount_ = nV;
+    solveFrameCount_ = nF;
+    // A solve continued from a checkpoint already has full resolution weights
+    bool success = iterStart > 0 ? compute()
+                                 : computeFrameBudget(frameBudget, multiResRatio, refineIters);
+    if (success) {
+      writeCheckpoint();
+    }
+    return success;
+  }
+
+  //! @return Number of global iterations run by solve
+  int solveIters() const {
+    if (iterStart > 0) {
+      return std::max(nIters - iterStart, 0);
+    }
+    return nIters + (multiResRatio < 1.0 ? refineIters : 0) +
+           (frameBudget > 0 && frameBudget < nF ? 1 : 0);
+  }
+
+  bool cancelled() const { return cancelled_; }
+  bool timedOut() const { return timedOut_; }
+  bool converged() const { return converged_; }
+
   void cbIterBegin() { std::cout << "    Iter #" << iter << ": "; }
 
-  void cbIterEnd() { std::cout << "RMSE = " << rmse() << "\n"; }
+  bool cbIterEnd() {
+    double error = rmse();
+    std::cout << "RMSE = " << error << "\n";
+    lastIter = iter + 1;
+    lastRmse = error;
+    // The coarse model of a multiresolution solve and the frame subset of a frame budget solve
+    // are not worth resuming from
+    if (checkpointInterval > 0 && lastIter % checkpointInterval == 0 && nV == solveVertexCount_ &&
+        nF == solveFrameCount_) {
+      writeCheckpoint();
+    }
+    if (showProgress) {
+      StepProgress(1);
+    }
+    if (shouldStop()) {
+      return true;
+    }
+    if (tolerance > 0.0 && prevRmse_ > 0.0 && prevRmse_ - error < tolerance * prevRmse_) {
+      if (++convergedIters_ >= patience) {
+        converged_ = true;
+        return true;
+      }
+    } else {
+      convergedIters_ = 0;
+    }
+    prevRmse_ = error;
+    return false;
+  }
+
+  bool cbRefineBegin() {
+    if (shouldStop()) {
+      return false;
+    }
+    // Convergence of the coarse solve says nothing about the full resolution refinement
+    prevRmse_ = -1.0;
+    convergedIters_ = 0;
+    converged_ = false;
+    return true;
+  }
 
   void cbInitSplitBegin() { std::cout << ">"; }
 
@@ -36,13 +204,59 @@ class MyDemBones : public DemBonesExt<double, float> {
 
   void cbTransformationsEnd() { std::cout << " Done! "; }
 
-  void cbTransformationsIterEnd() { std::cout << "."; }
+  bool cbTransformationsIterEnd() {
+    std::cout << ".";
+    return shouldStop();
+  }
+
+  bool cbWeightsIterEnd() {
+    std::cout << ".";
+    return shouldStop();
+  }
+
+ private:
+  void writeCheckpoint() {
+    if (checkpointFile.empty()) {
+      return;
+    }
+    std::string error;
+    if (!DemBonesCheckpoint::save(checkpointFile, *this, lastIter, error)) {
+      // May run on a background thread so this can not go through MGlobal
+      std::cerr << error << std::endl;
+    }
+  }
 
-  void cbWeightsIterEnd() { std::cout << "."; }
+  /**
+    Checks for cancellation and the time budget.  Once either triggers the model keeps the
+    result of the last completed update.
+  */
+  bool shouldStop() {
+    if (!cancelled_ && (cancelRequested || (showProgress && ProgressCancelled()))) {
+      cancelled_ = true;
+    }
+    if (maxTime > 0.0 && !timedOut_) {
+      double seconds =
+          std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+      timedOut_ = seconds > maxTime;
+    }
+    return cancelled_ || timedOut_;
+  }
+
+  double prevRmse_;
+  int convergedIters_;
+  bool cancelled_;
+  bool timedOut_;
+  bool converged_;
+  std::chrono::steady_clock::time_point start_;
+  MemoryMappedFile scratch_;
+  std::string scratchPath_;
+  int solveVertexCount_;
+  int solveFrameCount_;
 };
 
 class DemBonesCmd : public MPxCommand {
  public:
+  DemBonesCmd();
   virtual MStatus doIt(const MArgList& argList);
   virtual MStatus redoIt();
   virtual MStatus undoIt();
@@ -80,16 +294,158 @@ class DemBonesCmd : public MPxCommand {
   static const char* kEndFrameLong;
   static const char* kExistingBonesShort;
   static const char* kExistingBonesLong;
+  static const char* kCacheFileShort;
+  static const char* kCacheFileLong;
+  static const char* kScratchFileShort;
+  static const char* kScratchFileLong;
+  static const char* kFrameBlockShort;
+  static const char* kFrameBlockLong;
+  static const char* kToleranceShort;
+  static const char* kToleranceLong;
+  static const char* kPatienceShort;
+  static const char* kPatienceLong;
+  static const char* kMaxTimeShort;
+  static const char* kMaxTimeLong;
+  static const char* kCandidatesShort;
+  static const char* kCandidatesLong;
+  static const char* kMultiResShort;
+  static const char* kMultiResLong;
+  static const char* kRefineItersShort;
+  static const char* kRefineItersLong;
+  static const char* kCheckpointShort;
+  static const char* kCheckpointLong;
+  static const char* kCheckpointIntervalShort;
+  static const char* kCheckpointIntervalLong;
+  static const char* kResumeShort;
+  static const char* kResumeLong;
+  static const char* kBackgroundShort;
+  static const char* kBackgroundLong;
+  static const char* kJobStatusShort;
+  static const char* kJobStatusLong;
+  static const char* kJobProgressShort;
+  static const char* kJobProgressLong;
+  static const char* kCancelJobShort;
+  static const char* kCancelJobLong;
+  static const char* kListJobsShort;
+  static const char* kListJobsLong;
+  static const char* kCommitJobShort;
+  static const char* kCommitJobLong;
+  static const char* kCommitFinishedShort;
+  static const char* kCommitFinishedLong;
+  static const char* kInitMethodShort;
+  static const char* kInitMethodLong;
+  static const char* kIterativeSmoothShort;
+  static const char* kIterativeSmoothLong;
+  static const char* kKeyToleranceShort;
+  static const char* kKeyToleranceLong;
+  static const char* kFrameBudgetShort;
+  static const char* kFrameBudgetLong;
 
  private:
-  MStatus readMeshSequence(double startFrame, double endFrame);
+  /**
+    Reads the animated vertex positions and bone matrices in to the model.  Each frame range is
+    a separate subject.
+    @param[in] startFrames First frame of each subject.
+    @param[in] endFrames Last frame of each subject.
+    @param[in] caches Optional point cache of each subject to read the vertex positions from
+      instead of evaluating the mesh at each frame.
+  */
+  MStatus readMeshSequence(const std::vector<double>& startFrames,
+                           const std::vector<double>& endFrames,
+                           const std::vector<std::unique_ptr<PointCache>>& caches);
+
+  /**
+    Decodes the vertex positions of the point caches of all the subjects in to model_.v in
+    parallel.
+    @param[in] caches Point cache of each subject with one frame per subject frame.
+  */
+  void readPointCaches(const std::vector<std::unique_ptr<PointCache>>& caches);
+
+  /**
+    Reads the vertex positions of a resumed solve from point caches.  The bone data comes from
+    the checkpoint so the scene is not evaluated.
+    @param[in] caches Point cache of each checkpoint subject.
+  */
+  MStatus readCachedSequence(const std::vector<std::unique_ptr<PointCache>>& caches);
+
+  /**
+    Restores the state of a previous solve and continues its iteration count.
+    @param[in] path Checkpoint file written with -checkpoint.
+  */
+  MStatus loadCheckpoint(const MString& path);
+
+  /**
+    Reads the weights of the skinCluster deforming the mesh in to the model as a starting point.
+    Only the influences passed with -existingBones are used and the weights of each vertex are
+    renormalized over them.  The model is left without weights when the mesh is not skinned or
+    when -bones adds bones, since the new bones have no weights to start from.
+  */
+  MStatus readSkinWeights();
+
   MStatus readBindPose();
-  MStatus setKeyframes(const Eigen::VectorXd& val, const Eigen::VectorXd& fTime,
-                       const MDagPath& pathJoint, const MString& attributeName);
+  /**
+    Gets the plug of a world space output attribute for the instance of a dag path.
+    @param[in] path Path to the node.
+    @param[in] attribute Name of the world space array attribute such as worldMatrix.
+    @param[out] plug Storage for the element plug.
+  */
+  MStatus getWorldPlug(const MDagPath& path, const MString& attribute, MPlug& plug);
+
+  /**
+    Evaluates a plug at a frame in a DG context without changing the current time.
+    @param[in] plug Plug to evaluate.
+    @param[in] frame Frame in the current ui time unit.
+    @param[out] oData Storage for the plug data.
+  */
+  MStatus evaluatePlug(const MPlug& plug, double frame, MObject& oData);
+
+  /**
+    Evaluates a matrix plug at a frame in a DG context without changing the current time.
+    @param[in] plug Matrix plug to evaluate.
+    @param[in] frame Frame in the current ui time unit.
+    @param[out] matrix Storage for the matrix.
+  */
+  MStatus evaluateMatrix(const MPlug& plug, double frame, MMatrix& matrix);
+
+  /**
+    Keys an attribute of a joint with the solved animation.
+    @param[in] times Key times.
+    @param[in] values Key values in internal units.
+    @param[in] slopes Optional tangent slopes per frame of reduced keys.  The keys get Maya's
+      default tangents when null.
+    @param[in] pathJoint Path to the joint.
+    @param[in] attributeName Name of the attribute to key.
+  */
+  MStatus setKeyframes(const MTimeArray& times, const MDoubleArray& values,
+                       const MDoubleArray* slopes, const MDagPath& pathJoint,
+                       const MString& attributeName);
   MStatus setSkinCluster(const std::vector<std::string>& name, const Eigen::SparseMatrix<double>& w, const Eigen::MatrixXd& gb);
   Eigen::Matrix4d toMatrix4d(const MMatrix& m);
 
-  MyDemBones model_;
+  /**
+    Allocates the animated vertex matrix of the model, either in memory or in the scratch
+    file when one was requested.
+  */
+  MStatus allocateVertices();
+
+  /**
+    Handles the flags that query or control background jobs instead of starting a solve.
+    @param[in] argData Command arguments.
+    @param[out] handled Set to true if a job flag was found.
+  */
+  MStatus doJobFlags(const MArgDatabase& argData, bool& handled);
+
+  /**
+    Takes over the model of a finished background job and creates its results in the scene.
+    @param[in] id Job id.
+  */
+  MStatus commitJob(int id);
+
+  std::shared_ptr<MyDemBones> model_;
+  MString scratchFile_;
+  double keyTolerance_;
+  bool addBones_;
+  bool undoable_;
   MDGModifier dgMod_;
   MString name_;
   MDagPath pathMesh_;
@@ -0,0 +1,137 @@
+#include "demBonesJob.h"
+
+#include <maya/MGlobal.h>
+
+DemBonesJobQueue& DemBonesJobQueue::instance() {
+  static DemBonesJobQueue queue;
+  return queue;
+}
+
+DemBonesJobQueue::DemBonesJobQueue() : stop_(false), nextId_(1) {}
+
+DemBonesJobQueue::~DemBonesJobQueue() { shutdown(); }
+
+int DemBonesJobQueue::submit(const MDagPath& pathMesh, const std::shared_ptr<MyDemBones>& model) {
+  std::shared_ptr<DemBonesJob> job = std::make_shared<DemBonesJob>();
+  job->pathMesh = pathMesh;
+  job->model = model;
+  job->status = DemBonesJob::kQueued;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  job->id = nextId_++;
+  jobs_[job->id] = job;
+  pending_.push_back(job);
+  if (!worker_.joinable()) {
+    stop_ = false;
+    worker_ = std::thread(&DemBonesJobQueue::run, this);
+  }
+  wake_.notify_one();
+  return job->id;
+}
+
+std::shared_ptr<DemBonesJob> DemBonesJobQueue::job(int id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = jobs_.find(id);
+  return it == jobs_.end() ? nullptr : it->second;
+}
+
+bool DemBonesJobQueue::cancel(int id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = jobs_.find(id);
+  if (it == jobs_.end()) {
+    return false;
+  }
+  std::shared_ptr<DemBonesJob> job = it->second;
+  for (auto pending = pending_.begin(); pending != pending_.end(); ++pending) {
+    if (*pending == job) {
+      pending_.erase(pending);
+      job->status = DemBonesJob::kCancelled;
+      job->model->releaseVertices();
+      return true;
+    }
+  }
+  job->model->cancelRequested = true;
+  return true;
+}
+
+void DemBonesJobQueue::remove(int id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  jobs_.erase(id);
+}
+
+std::vector<int> DemBonesJobQueue::ids() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<int> ids;
+  for (auto& job : jobs_) {
+    ids.push_back(job.first);
+  }
+  return ids;
+}
+
+void DemBonesJobQueue::shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+    for (auto& job : jobs_) {
+      job.second->model->cancelRequested = true;
+    }
+    pending_.clear();
+    wake_.notify_one();
+  }
+  if (worker_.joinable()) {
+    worker_.join();
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  jobs_.clear();
+}
+
+MString DemBonesJobQueue::statusName(int status) {
+  switch (status) {
+    case DemBonesJob::kQueued:
+      return "queued";
+    case DemBonesJob::kRunning:
+      return "running";
+    case DemBonesJob::kFinished:
+      return "finished";
+    case DemBonesJob::kCancelled:
+      return "cancelled";
+    case DemBonesJob::kFailed:
+      return "failed";
+    case DemBonesJob::kCommitted:
+      return "committed";
+  }
+  return "unknown";
+}
+
+void DemBonesJobQueue::run() {
+  while (true) {
+    std::shared_ptr<DemBonesJob> job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait(lock, [this] { return stop_ || !pending_.empty(); });
+      if (stop_) {
+        return;
+      }
+      job = pending_.front();
+      pending_.pop_front();
+      job->status = DemBonesJob::kRunning;
+    }
+
+    // Only the snapshot in the model is used here, nothing may call in to the scene or MEL
+    MyDemBones& model = *job->model;
+    model.startSolve();
+    bool success = model.solve();
+    model.releaseVertices();
+
+    if (!success) {
+      job->status = DemBonesJob::kFailed;
+    } else if (model.cancelled()) {
+      job->status = DemBonesJob::kCancelled;
+    } else {
+      job->status = DemBonesJob::kFinished;
+      // Joints, keys and the skinCluster are created by the command on the main thread.  The
+      // job may be committed by hand before then so the idle commit skips a missing job.
+      MGlobal::executeCommandOnIdle(MString("demBones -commitFinished ") + job->id);
+    }
+  }
+}
@@ -0,0 +1,90 @@
+#ifndef CMT_DEMBONESJOB_H
+#define CMT_DEMBONESJOB_H
+
+#include "demBonesCmd.h"
+
+#include <maya/MDagPath.h>
+#include <maya/MString.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+  A demBones decomposition running in the background.  The job owns a snapshot of the mesh
+  sequence and bones taken on the main thread so the solve never touches the scene.
+*/
+struct DemBonesJob {
+  enum Status { kQueued, kRunning, kFinished, kCancelled, kFailed, kCommitted };
+
+  int id;
+  MDagPath pathMesh;
+  std::shared_ptr<MyDemBones> model;
+  std::atomic<int> status;
+};
+
+/**
+  Runs demBones jobs one after the other on a worker thread.  When a job finishes, the scene
+  is updated on the main thread by queueing a demBones -commitFinished command on idle.
+*/
+class DemBonesJobQueue {
+ public:
+  static DemBonesJobQueue& instance();
+
+  /**
+    Queues a decomposition.
+    @param[in] pathMesh Mesh the decomposition was read from.
+    @param[in] model Fully populated model.  It must not drive the main progress bar.
+    @return The id of the new job.
+  */
+  int submit(const MDagPath& pathMesh, const std::shared_ptr<MyDemBones>& model);
+
+  /**
+    Gets a job.
+    @param[in] id Job id.
+    @return The job or nullptr if there is no job with that id.
+  */
+  std::shared_ptr<DemBonesJob> job(int id);
+
+  /**
+    Requests a job to stop.  A queued job is dropped and a running job stops after its current
+    update, in both cases without changing the scene.
+    @param[in] id Job id.
+    @return false if there is no job with that id.
+  */
+  bool cancel(int id);
+
+  /**
+    Removes a job once its results are in the scene.
+    @param[in] id Job id.
+  */
+  void remove(int id);
+
+  /** Gets the ids of all jobs that have not been committed yet. */
+  std::vector<int> ids();
+
+  /** Cancels all jobs and waits for the worker thread to exit.  Called on plug-in unload. */
+  void shutdown();
+
+  static MString statusName(int status);
+
+ private:
+  DemBonesJobQueue();
+  ~DemBonesJobQueue();
+  void run();
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::deque<std::shared_ptr<DemBonesJob>> pending_;
+  std::map<int, std::shared_ptr<DemBonesJob>> jobs_;
+  std::thread worker_;
+  bool stop_;
+  int nextId_;
+};
+
+#endif
@@ -0,0 +1,450 @@
+#include "ikRigSolver.h"
+
+#include <cmath>
+
+using Eigen::AngleAxisd;
+using Eigen::Matrix3d;
+using Eigen::Matrix4d;
+using Eigen::Quaterniond;
+using Eigen::Vector3d;
+
+const int kIKRigParentPart[IKRig_Count] = {
+    -1,                   // Hips
+    IKRig_Hips,           // Chest
+    IKRig_Chest,          // Neck
+    IKRig_Neck,           // Head
+    IKRig_Chest,          // LeftClavicle
+    IKRig_LeftClavicle,   // LeftShoulder
+    IKRig_LeftShoulder,   // LeftElbow
+    IKRig_LeftElbow,      // LeftHand
+    IKRig_Hips,           // LeftUpLeg
+    IKRig_LeftUpLeg,      // LeftLoLeg
+    IKRig_LeftLoLeg,      // LeftFoot
+    IKRig_Chest,          // RightClavicle
+    IKRig_RightClavicle,  // RightShoulder
+    IKRig_RightShoulder,  // RightElbow
+    IKRig_RightElbow,     // RightHand
+    IKRig_Hips,           // RightUpLeg
+    IKRig_RightUpLeg,     // RightLoLeg
+    IKRig_RightLoLeg,     // RightFoot
+};
+
+/**
+  Equivalent of MQuaternion::asMatrix.  Maya matrices are the transpose of Eigen's column
+  vector rotation matrices.
+*/
+static Matrix4d asMatrix(const Quaterniond& q) {
+  Matrix4d m = Matrix4d::Identity();
+  m.topLeftCorner<3, 3>() = q.toRotationMatrix().transpose();
+  return m;
+}
+
+/**
+  Equivalent of MTransformationMatrix::setRotationQuaternion: replaces the rotation while
+  preserving the scale and translation.
+*/
+static Matrix4d setRotation(const Matrix4d& m, const Quaterniond& q) {
+  Matrix4d result = m;
+  Matrix3d r = q.toRotationMatrix().transpose();
+  for (int i = 0; i < 3; ++i) {
+    result.block<1, 3>(i, 0) = r.row(i) * m.block<1, 3>(i, 0).norm();
+  }
+  return result;
+}
+
+/**
+  Equivalent of MPoint * MMatrix.
+*/
+static Vector3d transformPoint(const Vector3d& p, const Matrix4d& m) {
+  return (p.homogeneous().transpose() * m).head<3>().transpose();
+}
+
+IKRigParameters::IKRigParameters()
+    : leftLegTwistOffset(0.0f),
+      rightLegTwistOffset(0.0f),
+      strideScale(1.0f),
+      rootMotionScale(1.0f),
+      characterScale(1.0f),
+      leftHandOffset(Matrix4d::Identity()) {}
+
+IKRigSolver::IKRigSolver()
+    : hipScale_(1.0),
+      spineScale_(1.0),
+      neckScale_(1.0),
+      strideScale_(1.0),
+      rootMotionScale_(1.0) {
+  for (unsigned int i = 0; i < IKRig_Count; ++i) {
+    inputMatrix_[i].setIdentity();
+    inputRestMatrix_[i].setIdentity();
+    targetRestMatrix_[i].setIdentity();
+    outputMatrix_[i].setIdentity();
+    rotationDelta_[i].setIdentity();
+    translationDelta_[i].setZero();
+  }
+  rootMotion_.setIdentity();
+  scaledRootMotion_.setIdentity();
+  toScaledRootMotion_.setIdentity();
+  hips_.setIdentity();
+  chest_.setIdentity();
+  reset();
+}
+
+void IKRigSolver::reset() {
+  while (!prevForward_.empty()) {
+    prevForward_.pop();
+  }
+  prevForward_.push(Vector3d::UnitZ());
+  prevForward_.push(Vector3d::UnitZ());
+}
+
+Quaterniond IKRigSolver::rotation(const Matrix4d& m) {
+  // Remove any scale before extracting the rotation
+  Matrix3d r = m.topLeftCorner<3, 3>();
+  for (int i = 0; i < 3; ++i) {
+    double length = r.row(i).norm();
+    if (length > 0.0) {
+      r.row(i) /= length;
+    }
+  }
+  Quaterniond q(Matrix3d(r.transpose()));
+  q.normalize();
+  return q;
+}
+
+Matrix4d IKRigSolver::outputLocalMatrix(unsigned int part) const {
+  int parent = kIKRigParentPart[part];
+  if (parent < 0) {
+    return outputMatrix_[part];
+  }
+  return outputMatrix_[part] * outputMatrix_[parent].inverse();
+}
+
+void IKRigSolver::solve(const MatrixArray& inputMatrix, const MatrixArray& inputRestMatrix,
+                        const MatrixArray& targetRestMatrix, const IKRigParameters& parameters) {
+  inputMatrix_ = inputMatrix;
+  inputRestMatrix_ = inputRestMatrix;
+  targetRestMatrix_ = targetRestMatrix;
+  rootMotionScale_ = parameters.rootMotionScale;
+  strideScale_ = parameters.strideScale;
+
+  for (unsigned int i = 0; i < IKRig_Count; ++i) {
+    Quaterniond rRest = rotation(inputRestMatrix_[i]);
+    Vector3d tRest = position(inputRestMatrix_[i]);
+
+    Quaterniond rCurrent = rotation(inputMatrix_[i]);
+    Vector3d tCurrent = position(inputMatrix_[i]);
+
+    rotationDelta_[i] = rCurrent * rRest.inverse();
+    translationDelta_[i] = tCurrent - tRest;
+  }
+
+  // Calculate Root Motion
+  rootMotion_ = calculateRootMotion();
+  scaledRootMotion_ = rootMotion_;
+  scaledRootMotion_(3, 0) *= rootMotionScale_;
+  scaledRootMotion_(3, 2) *= rootMotionScale_;
+  toScaledRootMotion_ = rootMotion_.inverse() * scaledRootMotion_;
+
+  // Hips
+  hipScale_ = position(targetRestMatrix_[IKRig_Hips]).y() /
+              position(inputRestMatrix_[IKRig_Hips]).y();
+  hips_ = inputMatrix_[IKRig_Hips] * rootMotion_.inverse();
+  Vector3d restInputHips = position(inputRestMatrix_[IKRig_Hips]);
+  Vector3d scaledHipPosition = restInputHips + (position(hips_) - restInputHips) * hipScale_;
+  hips_.block<1, 3>(3, 0) = scaledHipPosition.transpose();
+  hips_ *= rootMotion_;
+  Vector3d hipDelta = position(hips_) - restInputHips;
+  hips_ = offsetMatrix(targetRestMatrix_[IKRig_Hips], rotationDelta_[IKRig_Hips], hipDelta);
+  setOutput(IKRig_Hips, hips_ * toScaledRootMotion_);
+
+  calculateLegIk(IKRig_LeftUpLeg, IKRig_LeftLoLeg, IKRig_LeftFoot, hips_,
+                 parameters.leftLegTwistOffset);
+  calculateLegIk(IKRig_RightUpLeg, IKRig_RightLoLeg, IKRig_RightFoot, hips_,
+                 parameters.rightLegTwistOffset);
+  calculateChestIk();
+  calculateArmIk(IKRig_LeftClavicle, IKRig_LeftShoulder, IKRig_LeftElbow, IKRig_LeftHand, chest_,
+                 0.0f, parameters.leftHandOffset);
+  calculateArmIk(IKRig_RightClavicle, IKRig_RightShoulder, IKRig_RightElbow, IKRig_RightHand,
+                 chest_, 0.0f, Matrix4d::Identity());
+  calculateHeadIk(chest_);
+}
+
+Matrix4d IKRigSolver::calculateRootMotion() {
+  std::array<int, 4> rootInfluenceIndex = {IKRig_Hips, IKRig_Chest, IKRig_LeftUpLeg,
+                                           IKRig_RightUpLeg};
+  double weights[] = {0.5, 0.3, 0.1, 0.1};
+  Vector3d rootMotionTranslate = Vector3d::Zero();
+  Vector3d restRootMotionTranslate = Vector3d::Zero();
+  int col = 0;
+  Vector3d forward = Vector3d::Zero();
+  for (const auto& i : rootInfluenceIndex) {
+    forward += (rotationDelta_[i] * Vector3d::UnitZ()) * weights[col];
+    rootMotionTranslate += position(inputMatrix_[i]) * weights[col];
+    restRootMotionTranslate += position(inputRestMatrix_[i]) * weights[col];
+    ++col;
+  }
+  forward.y() = 0.0;
+  forward.normalize();
+
+  // Average with previous two forward vectors
+  forward += prevForward_.front();
+  prevForward_.pop();
+  forward += prevForward_.front();
+  forward.normalize();
+  prevForward_.push(forward);
+
+  Vector3d x = Vector3d::UnitY().cross(forward);
+  Matrix4d m = Matrix4d::Identity();
+  m.block<1, 3>(0, 0) = x.transpose();
+  m.block<1, 3>(1, 0) = Vector3d::UnitY().transpose();
+  m.block<1, 3>(2, 0) = forward.transpose();
+  m(3, 0) = rootMotionTranslate.x();
+  m(3, 1) = 0.0;
+  m(3, 2) = rootMotionTranslate.z();
+
+  Matrix4d restM = Matrix4d::Identity();
+  restM(3, 0) = restRootMotionTranslate.x();
+  restM(3, 2) = restRootMotionTranslate.z();
+  m *= restM.inverse();
+
+  return m;
+}
+
+void IKRigSolver::calculateLegIk(unsigned int upLegIdx, unsigned int loLegIdx,
+                                 unsigned int footIdx, const Matrix4d& hips, float twist) {
+  Matrix4d upLeg = targetRestMatrix_[upLegIdx] * targetRestMatrix_[IKRig_Hips].inverse() * hips;
+  Matrix4d loLeg = targetRestMatrix_[loLegIdx] * targetRestMatrix_[upLegIdx].inverse() * upLeg;
+  Matrix4d foot = targetRestMatrix_[footIdx] * targetRestMatrix_[loLegIdx].inverse() * loLeg;
+
+  // Foot target
+  // Account for differences in ankle height to help with ground contact
+  float ankleHeightDelta =
+      position(targetRestMatrix_[footIdx]).y() - position(inputRestMatrix_[footIdx]).y();
+  const Matrix4d& footRest = targetRestMatrix_[footIdx];
+  Matrix4d flatFootBindMatrix = Matrix4d::Identity();
+  flatFootBindMatrix(3, 0) = footRest(3, 0);
+  flatFootBindMatrix(3, 2) = footRest(3, 2);
+
+  Matrix4d footTarget = inputRestMatrix_[footIdx];
+  footTarget(3, 1) += ankleHeightDelta;
+  Vector3d footTranslationDelta = translationDelta_[footIdx];
+  footTranslationDelta.y() *= hipScale_;
+  footTarget = offsetMatrix(footTarget, rotationDelta_[footIdx], footTranslationDelta);
+  footTarget = footTarget * (rootMotion_.inverse() * flatFootBindMatrix.inverse());
+  // Scale foot position relative to resting stance
+  footTarget(3, 0) *= strideScale_;
+  footTarget(3, 2) *= strideScale_;
+  footTarget = footTarget * (flatFootBindMatrix * rootMotion_);
+
+  // Calculate leg ik
+  Vector3d ia = position(inputRestMatrix_[upLegIdx]);
+  Vector3d ib = position(inputRestMatrix_[loLegIdx]);
+  Vector3d ic = position(inputRestMatrix_[footIdx]);
+  Vector3d iac = (ic - ia).normalized();
+  Vector3d twistAxis = position(footTarget) - position(upLeg);
+  Vector3d pv = rotationDelta_[upLegIdx] * (ib - (ia + (iac * (ib - ia).dot(iac)))).normalized();
+  // Apply any twist offset
+  Quaterniond tw(AngleAxisd(twist * 0.0174533, twistAxis.normalized()));
+  pv = tw * pv;
+  pv += position(upLeg);
+  Matrix4d ikUpLeg, ikLoLeg;
+  calculateTwoBoneIk(upLeg, loLeg, foot, footTarget, pv, ikUpLeg, ikLoLeg);
+
+  Quaterniond footRotOffset =
+      rotation(targetRestMatrix_[footIdx] * inputRestMatrix_[footIdx].inverse());
+  Quaterniond footInputRot = rotation(inputMatrix_[footIdx]);
+  footRotOffset = footInputRot * footRotOffset;
+  Matrix4d ikFootPos =
+      targetRestMatrix_[footIdx] * targetRestMatrix_[loLegIdx].inverse() * ikLoLeg;
+  Matrix4d ikFoot = setRotation(ikFootPos, footRotOffset);
+
+  setOutput(upLegIdx, ikUpLeg * toScaledRootMotion_);
+  setOutput(loLegIdx, ikLoLeg * toScaledRootMotion_);
+  setOutput(footIdx, ikFoot * toScaledRootMotion_);
+}
+
+Matrix4d IKRigSolver::offsetMatrix(const Matrix4d& m, const Quaterniond& r,
+                                   const Vector3d& t) const {
+  // Equivalent of MTransformationMatrix::rotateBy and addTranslation in kPostTransform space
+  Matrix4d result = m;
+  result.topLeftCorner<3, 3>() = m.topLeftCorner<3, 3>() * r.toRotationMatrix().transpose();
+  result.block<1, 3>(3, 0) += t.transpose();
+  return result;
+}
+
+/*
+
+    @return The world space matrix of child with a scaled translation delta relative to the parent
+    in root motion space
+*/
+Matrix4d IKRigSolver::scaleRelativeTo(unsigned int inputChildIdx, unsigned int inputParentIdx,
+                                      double scale, const Matrix4d& targetParent) const {
+  Matrix4d restChild = inputRestMatrix_[inputChildIdx] *
+                       inputRestMatrix_[inputParentIdx].inverse() * inputMatrix_[inputParentIdx];
+
+  Quaterniond rRest = rotation(restChild);
+  Vector3d tRest = position(restChild);
+
+  Quaterniond rCurrent = rotation(inputMatrix_[inputChildIdx]);
+  Vector3d tCurrent = position(inputMatrix_[inputChildIdx]);
+
+  Quaterniond rotationDelta = rCurrent * rRest.inverse();
+  Vector3d translationDelta = (tCurrent - tRest) * scale;
+
+  Matrix4d restTarget =
+      targetRestMatrix_[inputChildIdx] * targetRestMatrix_[inputParentIdx].inverse() * targetParent;
+  return offsetMatrix(restTarget, rotationDelta, translationDelta);
+}
+
+void IKRigSolver::calculateTwoBoneIk(const Matrix4d& root, const Matrix4d& mid,
+                                     const Matrix4d& effector, const Matrix4d& target,
+                                     const Vector3d& pv, Matrix4d& ikA, Matrix4d& ikB) const {
+  Vector3d a = position(root);
+  Vector3d b = position(mid);
+  Vector3d c = position(effector);
+  Vector3d t = position(target);
+  Quaterniond a_gr = rotation(root);
+  Quaterniond b_gr = rotation(mid);
+  Vector3d ac = (c - a).normalized();
+  Vector3d d = (b - (a + (ac * (b - a).dot(ac)))).normalized();
+
+  twoBoneIk(a, b, c, d, t, pv, a_gr, b_gr);
+
+  ikA = asMatrix(a_gr);
+  ikA.block<1, 3>(3, 0) = a.transpose();
+  ikB = asMatrix(b_gr);
+  Matrix4d midPos = mid * root.inverse() * ikA;
+  ikB.block<1, 3>(3, 0) = midPos.block<1, 3>(3, 0);
+}
+
+// http://theorangeduck.com/page/simple-two-joint
+void IKRigSolver::twoBoneIk(const Vector3d& a, const Vector3d& b, const Vector3d& c,
+                            const Vector3d& d, const Vector3d& t, const Vector3d& pv,
+                            Quaterniond& a_gr, Quaterniond& b_gr) const {
+  float eps = 0.001f;
+  float lab = (b - a).norm();
+  float lcb = (b - c).norm();
+  float lat = clamp((t - a).norm(), eps, lab + lcb - eps);
+
+  // Get current interior angles of start and mid
+  float ac_ab_0 = std::acos(clamp((c - a).normalized().dot((b - a).normalized()), -1.0f, 1.0f));
+  float ba_bc_0 = std::acos(clamp((a - b).normalized().dot((c - b).normalized()), -1.0f, 1.0f));
+  float ac_at_0 = std::acos(clamp((c - a).normalized().dot((t - a).normalized()), -1.0f, 1.0f));
+
+  // Get desired interior angles
+  float ac_ab_1 =
+      std::acos(clamp((lcb * lcb - lab * lab - lat * lat) / (-2.0f * lab * lat), -1.0f, 1.0f));
+  float ba_bc_1 =
+      std::acos(clamp((lat * lat - lab * lab - lcb * lcb) / (-2.0f * lab * lcb), -1.0f, 1.0f));
+  Vector3d axis0 = (c - a).cross(d).normalized();
+  Vector3d axis1 = (c - a).cross(t - a).normalized();
+
+  Quaterniond r0(AngleAxisd(ac_ab_1 - ac_ab_0, axis0));
+  Quaterniond r1(AngleAxisd(ba_bc_1 - ba_bc_0, axis0));
+  Quaterniond r2(AngleAxisd(ac_at_0, axis1));
+
+  // Pole vector rotation
+  // Determine the rotation used to rotate the normal of the triangle formed by
+  // a.b.c post r0*r2 rotation to the normal of the triangle formed by triangle a.pv.t
+  Vector3d n1 = r2 * (r0 * (c - a).cross(b - a).normalized());
+  Vector3d n2 = (t - a).cross(pv - a).normalized();
+  Quaterniond r3 = Quaterniond::FromTwoVectors(n1, n2);
+
+  // Maya's a_gr *= r0 * r2 * r3 composes in the opposite order to Eigen
+  Quaterniond r = r3 * r2 * r0;
+  a_gr = r * a_gr;
+  b_gr = r1 * b_gr;
+  // Since we are calculating in world space, apply the start rotations to the mid
+  b_gr = r * b_gr;
+}
+
+void IKRigSolver::calculateChestIk() {
+  float targetSpineLength =
+      position(targetRestMatrix_[IKRig_Chest]).y() - position(targetRestMatrix_[IKRig_Hips]).y();
+  float inputSpineLength =
+      position(inputRestMatrix_[IKRig_Chest]).y() - position(inputRestMatrix_[IKRig_Hips]).y();
+  // Scale the local xform translation delta of the of the chest based on the spine length ratio
+  spineScale_ = targetSpineLength / inputSpineLength;
+  chest_ = scaleRelativeTo(IKRig_Chest, IKRig_Hips, spineScale_, hips_);
+  setOutput(IKRig_Chest, chest_ * toScaledRootMotion_);
+}
+
+void IKRigSolver::calculateArmIk(unsigned int clavicleIdx, unsigned int upArmIdx,
+                                 unsigned int loArmIdx, unsigned int handIdx,
+                                 const Matrix4d& chest, float twist, const Matrix4d& offset) {
+  Quaterniond clavicleOffset = rotation(inputRestMatrix_[clavicleIdx].inverse()) *
+                               rotation(targetRestMatrix_[clavicleIdx]);
+  Quaterniond clavicleRotation = rotation(inputMatrix_[clavicleIdx]) * clavicleOffset;
+  Vector3d claviclePosition =
+      transformPoint(position(targetRestMatrix_[clavicleIdx]),
+                     targetRestMatrix_[IKRig_Chest].inverse() * chest);
+  Matrix4d clavicle = asMatrix(clavicleRotation);
+  clavicle.block<1, 3>(3, 0) = claviclePosition.transpose();
+
+  Matrix4d upArm =
+      targetRestMatrix_[upArmIdx] * targetRestMatrix_[clavicleIdx].inverse() * clavicle;
+  Matrix4d loArm = targetRestMatrix_[loArmIdx] * targetRestMatrix_[upArmIdx].inverse() * upArm;
+  Matrix4d hand = targetRestMatrix_[handIdx] * targetRestMatrix_[loArmIdx].inverse() * loArm;
+
+  // Hand target
+  // Account for differences in arm length
+  float targetArmLength =
+      (position(targetRestMatrix_[loArmIdx]) - position(targetRestMatrix_[upArmIdx])).norm() +
+      (position(targetRestMatrix_[handIdx]) - position(targetRestMatrix_[loArmIdx])).norm();
+  float inArmLength =
+      (position(inputRestMatrix_[loArmIdx]) - position(inputRestMatrix_[upArmIdx])).norm() +
+      (position(inputRestMatrix_[handIdx]) - position(inputRestMatrix_[loArmIdx])).norm();
+
+  float armScale = targetArmLength / inArmLength;
+  // The offset is local to the hand target, identity leaves the target alone
+  Matrix4d handTarget = offset * scaleRelativeTo(handIdx, clavicleIdx, armScale, clavicle);
+
+  // Calculate arm ik
+  Vector3d ia = position(inputRestMatrix_[upArmIdx]);
+  Vector3d ib = position(inputRestMatrix_[loArmIdx]);
+  Vector3d ic = position(inputRestMatrix_[handIdx]);
+  Vector3d iac = (ic - ia).normalized();
+  Vector3d twistAxis = position(handTarget) - position(upArm);
+  // pv location is vector from input elbow projected on to shoulder-to-hand vector to elbow
+  // rotated in to worldspace
+  Vector3d pv = rotationDelta_[upArmIdx] * (ib - (ia + (iac * (ib - ia).dot(iac)))).normalized();
+  // Apply any twist offset
+  Quaterniond tw(AngleAxisd(twist * 0.0174533, twistAxis.normalized()));
+  pv = tw * pv;
+  pv += position(upArm);
+  Matrix4d ikUpArm, ikLoArm;
+  calculateTwoBoneIk(upArm, loArm, hand, handTarget, pv, ikUpArm, ikLoArm);
+
+  // Hand rotation
+  Quaterniond handOffset =
+      rotation(inputRestMatrix_[handIdx].inverse()) * rotation(targetRestMatrix_[handIdx]);
+  Quaterniond handRotation = rotation(inputMatrix_[handIdx]) * handOffset;
+  Matrix4d ikHandPos =
+      targetRestMatrix_[handIdx] * targetRestMatrix_[loArmIdx].inverse() * ikLoArm;
+  Matrix4d ikHand = setRotation(ikHandPos, handRotation);
+
+  setOutput(clavicleIdx, clavicle * toScaledRootMotion_);
+  setOutput(upArmIdx, ikUpArm * toScaledRootMotion_);
+  setOutput(loArmIdx, ikLoArm * toScaledRootMotion_);
+  setOutput(handIdx, ikHand * toScaledRootMotion_);
+}
+
+void IKRigSolver::calculateHeadIk(const Matrix4d& chest) {
+  // Neck rotation
+  Quaterniond neckOffset = rotation(inputRestMatrix_[IKRig_Neck].inverse()) *
+                           rotation(targetRestMatrix_[IKRig_Neck]);
+  Quaterniond neckRotation = rotation(inputMatrix_[IKRig_Neck]) * neckOffset;
+  Matrix4d ikNeckPos =
+      targetRestMatrix_[IKRig_Neck] * targetRestMatrix_[IKRig_Chest].inverse() * chest;
+  Matrix4d neck = setRotation(ikNeckPos, neckRotation);
+  setOutput(IKRig_Neck, neck * toScaledRootMotion_);
+
+  float targetNeckLength =
+      position(targetRestMatrix_[IKRig_Head]).y() - position(targetRestMatrix_[IKRig_Neck]).y();
+  float inputNeckLength =
+      position(inputRestMatrix_[IKRig_Head]).y() - position(inputRestMatrix_[IKRig_Neck]).y();
+  // Scale the local xform translation delta of the of the chest based on the spine length ratio
+  neckScale_ = targetNeckLength / inputNeckLength;
+  Matrix4d head = scaleRelativeTo(IKRig_Head, IKRig_Neck, neckScale_, neck);
+  setOutput(IKRig_Head, head * toScaledRootMotion_);
+}
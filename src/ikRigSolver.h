@@ -0,0 +1,157 @@
+#ifndef CMT_IKRIGSOLVER_H
+#define CMT_IKRIGSOLVER_H
+
+#include <Eigen/Dense>
+
+#include <array>
+#include <queue>
+
+/**
+  Maya-free implementation of the ikRig retarget solve.  Used by the ikRig node and by the
+  offline retarget tools.
+
+  Matrices follow the Maya convention: row vectors (p' = p * M) with the translation stored in
+  the last row, so m(r, c) == MMatrix[r][c].  Quaternions use the same x, y, z, w components as
+  MQuaternion.  Note that Maya composes quaternions in the opposite order to Eigen (Maya q1 * q2
+  is Eigen q2 * q1).
+*/
+
+enum IKRigPart {
+  IKRig_Hips,
+  IKRig_Chest,
+  IKRig_Neck,
+  IKRig_Head,
+  IKRig_LeftClavicle,
+  IKRig_LeftShoulder,
+  IKRig_LeftElbow,
+  IKRig_LeftHand,
+  IKRig_LeftUpLeg,
+  IKRig_LeftLoLeg,
+  IKRig_LeftFoot,
+  IKRig_RightClavicle,
+  IKRig_RightShoulder,
+  IKRig_RightElbow,
+  IKRig_RightHand,
+  IKRig_RightUpLeg,
+  IKRig_RightLoLeg,
+  IKRig_RightFoot,
+  IKRig_Count
+};
+
+/**
+  The ikRig part each part is parented under.  -1 is world.
+*/
+extern const int kIKRigParentPart[IKRig_Count];
+
+struct IKRigParameters {
+  IKRigParameters();
+  float leftLegTwistOffset;
+  float rightLegTwistOffset;
+  float strideScale;
+  float rootMotionScale;
+  float characterScale;
+  Eigen::Matrix4d leftHandOffset;
+};
+
+class IKRigSolver {
+ public:
+  typedef std::array<Eigen::Matrix4d, IKRig_Count> MatrixArray;
+
+  IKRigSolver();
+
+  /**
+    Clears any state carried between solves such as the root motion smoothing.  Call between
+    unrelated clips.
+  */
+  void reset();
+
+  /**
+    Retargets a single pose.
+    @param[in] inputMatrix World matrices of the source skeleton.
+    @param[in] inputRestMatrix World rest matrices of the source skeleton.
+    @param[in] targetRestMatrix World rest matrices of the target skeleton.
+    @param[in] parameters Retarget settings.
+  */
+  void solve(const MatrixArray& inputMatrix, const MatrixArray& inputRestMatrix,
+             const MatrixArray& targetRestMatrix, const IKRigParameters& parameters);
+
+  /**
+    @return The world space output matrix of a part from the last solve.
+  */
+  const Eigen::Matrix4d& outputMatrix(unsigned int part) const { return outputMatrix_[part]; }
+
+  /**
+    @return The output matrix of a part relative to its parent part from the last solve.
+  */
+  Eigen::Matrix4d outputLocalMatrix(unsigned int part) const;
+
+  /**
+    @return The scaled root motion matrix from the last solve.
+  */
+  const Eigen::Matrix4d& rootMotion() const { return scaledRootMotion_; }
+
+  /**
+    Extracts the rotation of a matrix, equivalent to MTransformationMatrix::rotation.
+  */
+  static Eigen::Quaterniond rotation(const Eigen::Matrix4d& m);
+
+ private:
+  Eigen::Matrix4d calculateRootMotion();
+  void calculateLegIk(unsigned int upLeg, unsigned int loLeg, unsigned int foot,
+                      const Eigen::Matrix4d& hips, float twist);
+  void calculateChestIk();
+  void calculateArmIk(unsigned int clavicleIdx, unsigned int upArm, unsigned int loArm,
+                      unsigned int hand, const Eigen::Matrix4d& chest, float twist,
+                      const Eigen::Matrix4d& offset);
+  void calculateHeadIk(const Eigen::Matrix4d& chest);
+
+  Eigen::Vector3d position(const Eigen::Matrix4d& m) const {
+    return Eigen::Vector3d(m(3, 0), m(3, 1), m(3, 2));
+  }
+  Eigen::Matrix4d offsetMatrix(const Eigen::Matrix4d& m, const Eigen::Quaterniond& r,
+                               const Eigen::Vector3d& t) const;
+  Eigen::Matrix4d scaleRelativeTo(unsigned int inputChildIdx, unsigned int inputParentIdx,
+                                  double scale, const Eigen::Matrix4d& targetParent) const;
+  void calculateTwoBoneIk(const Eigen::Matrix4d& root, const Eigen::Matrix4d& mid,
+                          const Eigen::Matrix4d& effector, const Eigen::Matrix4d& target,
+                          const Eigen::Vector3d& pv, Eigen::Matrix4d& ikA,
+                          Eigen::Matrix4d& ikB) const;
+  void twoBoneIk(const Eigen::Vector3d& a, const Eigen::Vector3d& b, const Eigen::Vector3d& c,
+                 const Eigen::Vector3d& d, const Eigen::Vector3d& t, const Eigen::Vector3d& pv,
+                 Eigen::Quaterniond& a_gr, Eigen::Quaterniond& b_gr) const;
+  void setOutput(unsigned int bodyPart, const Eigen::Matrix4d& matrix) {
+    outputMatrix_[bodyPart] = matrix;
+  }
+  float clamp(float inValue, float minValue, float maxValue) const {
+    if (inValue < minValue) {
+      return minValue;
+    }
+    if (inValue > maxValue) {
+      return maxValue;
+    }
+    return inValue;
+  }
+
+  MatrixArray inputMatrix_;
+  MatrixArray inputRestMatrix_;
+  MatrixArray targetRestMatrix_;
+  MatrixArray outputMatrix_;
+  std::array<Eigen::Quaterniond, IKRig_Count> rotationDelta_;
+  std::array<Eigen::Vector3d, IKRig_Count> translationDelta_;
+  Eigen::Matrix4d rootMotion_;
+  Eigen::Matrix4d scaledRootMotion_;
+  Eigen::Matrix4d toScaledRootMotion_;
+  Eigen::Matrix4d hips_;
+  Eigen::Matrix4d chest_;
+  double hipScale_;
+  double spineScale_;
+  double neckScale_;
+  double strideScale_;
+  double rootMotionScale_;
+  std::queue<Eigen::Vector3d> prevForward_;
+
+ public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+#endif
@@ -0,0 +1,113 @@
+#include "keyReducer.h"
+
+#include <cmath>
+#include <utility>
+
+namespace {
+
+/**
+  Estimates the derivative of a sampled channel with the three point formula for uneven spacing
+  and one sided differences at the ends.
+*/
+void sampleSlopes(const double* time, const double* value, int count, std::vector<double>& slope) {
+  slope.assign(count, 0.0);
+  if (count < 2) {
+    return;
+  }
+  slope[0] = (value[1] - value[0]) / (time[1] - time[0]);
+  slope[count - 1] =
+      (value[count - 1] - value[count - 2]) / (time[count - 1] - time[count - 2]);
+  for (int i = 1; i < count - 1; ++i) {
+    double h0 = time[i] - time[i - 1];
+    double h1 = time[i + 1] - time[i];
+    slope[i] = (h1 * h1 * (value[i] - value[i - 1]) + h0 * h0 * (value[i + 1] - value[i])) /
+               (h0 * h1 * (h0 + h1));
+  }
+}
+
+}  // namespace
+
+void KeyReducer::reduce(const double* time, const double* value, int count, double tolerance,
+                        Curve& curve) {
+  curve.keys.clear();
+  curve.slopes.clear();
+  if (count <= 0) {
+    return;
+  }
+
+  // A channel that never leaves the tolerance of its first value only needs flat keys at its
+  // ends.  The last key holds the value when more keys follow on the same curve.
+  bool flat = true;
+  for (int i = 1; i < count && flat; ++i) {
+    flat = std::abs(value[i] - value[0]) <= tolerance;
+  }
+  if (flat) {
+    curve.keys.push_back(0);
+    curve.slopes.push_back(0.0);
+    if (count > 1) {
+      curve.keys.push_back(count - 1);
+      curve.slopes.push_back(0.0);
+    }
+    return;
+  }
+
+  std::vector<double> slope;
+  sampleSlopes(time, value, count, slope);
+
+  std::vector<char> keep(count, 0);
+  keep[0] = 1;
+  keep[count - 1] = 1;
+  std::vector<std::pair<int, int>> segments;
+  segments.push_back(std::make_pair(0, count - 1));
+  while (!segments.empty()) {
+    int a = segments.back().first;
+    int b = segments.back().second;
+    segments.pop_back();
+    if (b - a < 2) {
+      continue;
+    }
+    double h = time[b] - time[a];
+    double ma = slope[a] * h;
+    double mb = slope[b] * h;
+    double worst = tolerance;
+    int split = -1;
+    for (int i = a + 1; i < b; ++i) {
+      double s = (time[i] - time[a]) / h;
+      double s2 = s * s;
+      double s3 = s2 * s;
+      double fit = (2.0 * s3 - 3.0 * s2 + 1.0) * value[a] + (s3 - 2.0 * s2 + s) * ma +
+                   (3.0 * s2 - 2.0 * s3) * value[b] + (s3 - s2) * mb;
+      double error = std::abs(fit - value[i]);
+      if (error > worst) {
+        worst = error;
+        split = i;
+      }
+    }
+    if (split != -1) {
+      keep[split] = 1;
+      segments.push_back(std::make_pair(a, split));
+      segments.push_back(std::make_pair(split, b));
+    }
+  }
+
+  for (int i = 0; i < count; ++i) {
+    if (keep[i]) {
+      curve.keys.push_back(i);
+      curve.slopes.push_back(slope[i]);
+    }
+  }
+}
+
+int KeyReducer::reduce(const Eigen::VectorXd& time, const Eigen::MatrixXd& samples,
+                       const Eigen::VectorXd& tolerance, std::vector<Curve>& curves) {
+  int channelCount = static_cast<int>(samples.cols());
+  int count = static_cast<int>(samples.rows());
+  curves.resize(channelCount);
+  int keyCount = 0;
+#pragma omp parallel for schedule(dynamic) reduction(+ : keyCount)
+  for (int c = 0; c < channelCount; ++c) {
+    reduce(time.data(), samples.col(c).data(), count, tolerance(c), curves[c]);
+    keyCount += static_cast<int>(curves[c].keys.size());
+  }
+  return keyCount;
+}
@@ -0,0 +1,51 @@
+#ifndef CMT_KEYREDUCER_H
+#define CMT_KEYREDUCER_H
+
+#include <Eigen/Dense>
+
+#include <vector>
+
+/**
+  Reduces densely sampled animation channels to a sparse set of keys with fixed tangents.
+
+  Each channel is fit with cubic Hermite segments, the same interpolation Maya uses for
+  non-weighted curves.  Keys are placed on sample times and their tangents are the derivative of
+  the sampled channel so the fit follows the slope of the motion and not just the values.  A
+  segment whose interpolation deviates from any of its samples by more than the tolerance is
+  split at the worst sample until every sample is within the tolerance.  The first and last
+  samples are always keyed so several reduced sequences can be keyed on one curve.
+*/
+class KeyReducer {
+ public:
+  /** Keys of a reduced channel. */
+  struct Curve {
+    /** Sample index of each key in increasing order. */
+    std::vector<int> keys;
+    /** Tangent slope of each key in value units per time unit. */
+    std::vector<double> slopes;
+  };
+
+  /**
+    Reduces all the channels of a sequence in parallel.
+    @param[in] time Sample times in strictly increasing order.
+    @param[in] samples Channel values with a column per channel and a row per sample time.
+    @param[in] tolerance Maximum absolute deviation of each channel.
+    @param[out] curves Storage for the keys of each channel.
+    @return Total number of keys over all channels.
+  */
+  static int reduce(const Eigen::VectorXd& time, const Eigen::MatrixXd& samples,
+                    const Eigen::VectorXd& tolerance, std::vector<Curve>& curves);
+
+  /**
+    Reduces a single channel.
+    @param[in] time Sample times in strictly increasing order.
+    @param[in] value Channel values at each sample time.
+    @param[in] count Number of samples.
+    @param[in] tolerance Maximum absolute deviation.
+    @param[out] curve Storage for the keys.
+  */
+  static void reduce(const double* time, const double* value, int count, double tolerance,
+                     Curve& curve);
+};
+
+#endif
@@ -0,0 +1,159 @@
+#include "memoryMappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MemoryMappedFile::MemoryMappedFile()
+    : data_(nullptr), size_(0), file_(INVALID_HANDLE_VALUE), mapping_(nullptr) {}
+
+bool MemoryMappedFile::open(const std::string& path, std::string& error) {
+  close();
+  file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                      FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (file_ == INVALID_HANDLE_VALUE) {
+    error = "Unable to open " + path;
+    return false;
+  }
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file_, &size) || size.QuadPart == 0) {
+    error = path + " is empty";
+    close();
+    return false;
+  }
+  mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping_ == nullptr) {
+    error = "Unable to map " + path;
+    close();
+    return false;
+  }
+  data_ = MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+  if (data_ == nullptr) {
+    error = "Unable to map " + path;
+    close();
+    return false;
+  }
+  size_ = static_cast<size_t>(size.QuadPart);
+  return true;
+}
+
+bool MemoryMappedFile::create(const std::string& path, size_t size, std::string& error) {
+  close();
+  file_ = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                      FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file_ == INVALID_HANDLE_VALUE) {
+    error = "Unable to create " + path;
+    return false;
+  }
+  LARGE_INTEGER fileSize;
+  fileSize.QuadPart = static_cast<LONGLONG>(size);
+  mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READWRITE, fileSize.HighPart,
+                                fileSize.LowPart, nullptr);
+  if (mapping_ == nullptr) {
+    error = "Unable to map " + path;
+    close();
+    return false;
+  }
+  data_ = MapViewOfFile(mapping_, FILE_MAP_WRITE, 0, 0, 0);
+  if (data_ == nullptr) {
+    error = "Unable to map " + path;
+    close();
+    return false;
+  }
+  size_ = size;
+  return true;
+}
+
+void MemoryMappedFile::close() {
+  if (data_ != nullptr) {
+    UnmapViewOfFile(data_);
+  }
+  if (mapping_ != nullptr) {
+    CloseHandle(mapping_);
+  }
+  if (file_ != INVALID_HANDLE_VALUE) {
+    CloseHandle(file_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+  mapping_ = nullptr;
+  file_ = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+MemoryMappedFile::MemoryMappedFile() : data_(nullptr), size_(0), file_(-1) {}
+
+bool MemoryMappedFile::open(const std::string& path, std::string& error) {
+  close();
+  file_ = ::open(path.c_str(), O_RDONLY);
+  if (file_ < 0) {
+    error = "Unable to open " + path;
+    return false;
+  }
+  struct stat info;
+  if (fstat(file_, &info) != 0 || info.st_size == 0) {
+    error = path + " is empty";
+    close();
+    return false;
+  }
+  void* data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file_, 0);
+  if (data == MAP_FAILED) {
+    error = "Unable to map " + path;
+    close();
+    return false;
+  }
+  // Frames are decoded front to back so let the kernel read ahead aggressively
+  madvise(data, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+  data_ = data;
+  size_ = static_cast<size_t>(info.st_size);
+  return true;
+}
+
+bool MemoryMappedFile::create(const std::string& path, size_t size, std::string& error) {
+  close();
+  file_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (file_ < 0) {
+    error = "Unable to create " + path;
+    return false;
+  }
+  if (size == 0 || ftruncate(file_, static_cast<off_t>(size)) != 0) {
+    error = "Unable to resize " + path;
+    close();
+    return false;
+  }
+  void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file_, 0);
+  if (data == MAP_FAILED) {
+    error = "Unable to map " + path;
+    close();
+    return false;
+  }
+  data_ = data;
+  size_ = size;
+  return true;
+}
+
+void MemoryMappedFile::close() {
+  if (data_ != nullptr) {
+    munmap(data_, size_);
+  }
+  if (file_ >= 0) {
+    ::close(file_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+  file_ = -1;
+}
+
+#endif
+
+MemoryMappedFile::~MemoryMappedFile() { close(); }
@@ -0,0 +1,62 @@
+#ifndef CMT_MEMORYMAPPEDFILE_H
+#define CMT_MEMORYMAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+
+/**
+  Memory mapping of a whole file.  Existing files are mapped read-only with open and new
+  files are mapped read-write with create.  The mapping is released when the object is
+  destroyed or closed.
+*/
+class MemoryMappedFile {
+ public:
+  MemoryMappedFile();
+  ~MemoryMappedFile();
+  MemoryMappedFile(const MemoryMappedFile&) = delete;
+  MemoryMappedFile& operator=(const MemoryMappedFile&) = delete;
+
+  /**
+    Maps a file in to memory.
+    @param[in] path File path.
+    @param[out] error Error description on failure.
+    @return true on success.
+  */
+  bool open(const std::string& path, std::string& error);
+
+  /**
+    Creates a file of the given size and maps it read-write.  An existing file is overwritten.
+    Pages written through the mapping are flushed to the file by the OS so the mapped data
+    can be larger than the physical memory.
+    @param[in] path File path.
+    @param[in] size File size in bytes.
+    @param[out] error Error description on failure.
+    @return true on success.
+  */
+  bool create(const std::string& path, size_t size, std::string& error);
+
+  /**
+    Unmaps the file.
+  */
+  void close();
+
+  bool isOpen() const { return data_ != nullptr; }
+  const char* data() const { return static_cast<const char*>(data_); }
+  /**
+    @return The writable mapping.  Only valid for files mapped with create.
+  */
+  char* data() { return static_cast<char*>(data_); }
+  size_t size() const { return size_; }
+
+ private:
+  void* data_;
+  size_t size_;
+#ifdef _WIN32
+  void* file_;
+  void* mapping_;
+#else
+  int file_;
+#endif
+};
+
+#endif
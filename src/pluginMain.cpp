@@ -2,8 +2,10 @@
 #include <maya/MFnPlugin.h>
 
 #include "demBonesCmd.h"
+#include "demBonesJob.h"
 #include "ikRigNode.h"
 #include "rbfNode.h"
+#include "swingTwistArrayNode.h"
 #include "swingTwistCmd.h"
 #include "swingTwistNode.h"
 
@@ -27,12 +29,20 @@ MStatus initializePlugin(MObject obj) {
                                IKRigNode::initialize);
   CHECK_MSTATUS_AND_RETURN_IT(status);
 
+  status = plugin.registerNode(SwingTwistArrayNode::kName, SwingTwistArrayNode::id,
+                               SwingTwistArrayNode::creator, SwingTwistArrayNode::initialize);
+  CHECK_MSTATUS_AND_RETURN_IT(status);
+
   return status;
 }
 
 MStatus uninitializePlugin(MObject obj) {
   MStatus status;
   MFnPlugin plugin(obj);
+  // Background solves must not outlive the code they run
+  DemBonesJobQueue::instance().shutdown();
+  status = plugin.deregisterNode(SwingTwistArrayNode::id);
+  CHECK_MSTATUS_AND_RETURN_IT(status);
   status = plugin.deregisterNode(IKRigNode::id);
   CHECK_MSTATUS_AND_RETURN_IT(status);
   status = plugin.deregisterCommand(DemBonesCmd::kName);
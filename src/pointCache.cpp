@@ -0,0 +1,47 @@
+#include "pointCache.h"
+
+#include <cstring>
+
+static const char kMagic[4] = {'C', 'M', 'T', 'P'};
+static const uint32_t kVersion = 1;
+static const size_t kHeaderSize = 32;
+
+PointCache::PointCache()
+    : points_(nullptr), vertexCount_(0), frameCount_(0), startFrame_(0.0), frameRate_(30.0) {}
+
+bool PointCache::open(const std::string& path, std::string& error) {
+  points_ = nullptr;
+  vertexCount_ = 0;
+  frameCount_ = 0;
+  if (!file_.open(path, error)) {
+    return false;
+  }
+  const char* data = file_.data();
+  if (file_.size() < kHeaderSize || std::memcmp(data, kMagic, sizeof(kMagic)) != 0) {
+    error = path + " is not a point cache file";
+    file_.close();
+    return false;
+  }
+  uint32_t version;
+  std::memcpy(&version, data + 4, sizeof(version));
+  if (version != kVersion) {
+    error = path + " has unsupported version " + std::to_string(version);
+    file_.close();
+    return false;
+  }
+  uint32_t vertexCount, frameCount;
+  std::memcpy(&vertexCount, data + 8, sizeof(vertexCount));
+  std::memcpy(&frameCount, data + 12, sizeof(frameCount));
+  std::memcpy(&startFrame_, data + 16, sizeof(startFrame_));
+  std::memcpy(&frameRate_, data + 24, sizeof(frameRate_));
+  size_t expected = kHeaderSize + static_cast<size_t>(vertexCount) * frameCount * 3 * sizeof(float);
+  if (file_.size() < expected) {
+    error = path + " is truncated";
+    file_.close();
+    return false;
+  }
+  vertexCount_ = vertexCount;
+  frameCount_ = frameCount;
+  points_ = reinterpret_cast<const float*>(data + kHeaderSize);
+  return true;
+}
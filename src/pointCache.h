@@ -0,0 +1,57 @@
+#ifndef CMT_POINTCACHE_H
+#define CMT_POINTCACHE_H
+
+#include "memoryMappedFile.h"
+
+#include <cstdint>
+#include <string>
+
+/**
+  Memory mapped vertex animation cache used to feed mesh sequences to the demBones command
+  without stepping Maya time.
+
+  Layout (little endian):
+    char[4]  magic "CMTP"
+    uint32   version
+    uint32   vertexCount
+    uint32   frameCount
+    double   startFrame
+    double   frameRate
+    float[3] * vertexCount * frameCount    World space positions, frame major
+
+  The header is 32 bytes so the positions are 4 byte aligned in the mapping.
+*/
+class PointCache {
+ public:
+  PointCache();
+
+  /**
+    Opens and validates a point cache file.
+    @param[in] path File path.
+    @param[out] error Error description on failure.
+    @return true on success.
+  */
+  bool open(const std::string& path, std::string& error);
+
+  unsigned int vertexCount() const { return vertexCount_; }
+  unsigned int frameCount() const { return frameCount_; }
+  double startFrame() const { return startFrame_; }
+  double frameRate() const { return frameRate_; }
+
+  /**
+    @return Pointer to the xyz positions of all the vertices of a frame.
+  */
+  const float* frame(unsigned int frame) const {
+    return points_ + static_cast<size_t>(frame) * vertexCount_ * 3;
+  }
+
+ private:
+  MemoryMappedFile file_;
+  const float* points_;
+  uint32_t vertexCount_;
+  uint32_t frameCount_;
+  double startFrame_;
+  double frameRate_;
+};
+
+#endif
@@ -0,0 +1,173 @@
+#include "swingTwistArrayNode.h"
+#include "swingTwistNode.h"
+
+#include <maya/MArrayDataBuilder.h>
+#include <maya/MArrayDataHandle.h>
+#include <maya/MFnEnumAttribute.h>
+#include <maya/MFnMatrixAttribute.h>
+#include <maya/MFnNumericAttribute.h>
+#include <maya/MMatrix.h>
+#include <maya/MMatrixArray.h>
+#include <maya/MQuaternion.h>
+
+#include <vector>
+
+#include "common.h"
+
+MTypeId SwingTwistArrayNode::id(0x0011581C);
+MObject SwingTwistArrayNode::aOutMatrix;
+MObject SwingTwistArrayNode::aInMatrix;
+MObject SwingTwistArrayNode::aTargetRestMatrix;
+MObject SwingTwistArrayNode::aRestMatrix;
+MObject SwingTwistArrayNode::aTwistWeight;
+MObject SwingTwistArrayNode::aSwingWeight;
+MObject SwingTwistArrayNode::aTwistAxis;
+
+const MString SwingTwistArrayNode::kName("swingTwistArray");
+
+MStatus SwingTwistArrayNode::initialize() {
+  MStatus status;
+
+  MFnEnumAttribute eAttr;
+  MFnMatrixAttribute mAttr;
+  MFnNumericAttribute nAttr;
+
+  aOutMatrix = mAttr.create("outMatrix", "outMatrix");
+  mAttr.setArray(true);
+  mAttr.setUsesArrayDataBuilder(true);
+  mAttr.setWritable(false);
+  mAttr.setStorable(false);
+  addAttribute(aOutMatrix);
+
+  aInMatrix = mAttr.create("driverMatrix", "driverMatrix");
+  mAttr.setArray(true);
+  mAttr.setUsesArrayDataBuilder(true);
+  addAttribute(aInMatrix);
+  attributeAffects(aInMatrix, aOutMatrix);
+
+  aRestMatrix = mAttr.create("driverRestMatrix", "driverRestMatrix");
+  mAttr.setArray(true);
+  mAttr.setUsesArrayDataBuilder(true);
+  addAttribute(aRestMatrix);
+  attributeAffects(aRestMatrix, aOutMatrix);
+
+  aTargetRestMatrix = mAttr.create("targetRestMatrix", "targetRestMatrix");
+  mAttr.setArray(true);
+  mAttr.setUsesArrayDataBuilder(true);
+  addAttribute(aTargetRestMatrix);
+  attributeAffects(aTargetRestMatrix, aOutMatrix);
+
+  aTwistWeight = nAttr.create("twist", "twist", MFnNumericData::kFloat, 1.0);
+  nAttr.setKeyable(true);
+  nAttr.setMin(-1.0);
+  nAttr.setMax(1.0);
+  nAttr.setArray(true);
+  nAttr.setUsesArrayDataBuilder(true);
+  addAttribute(aTwistWeight);
+  attributeAffects(aTwistWeight, aOutMatrix);
+
+  aSwingWeight = nAttr.create("swing", "swing", MFnNumericData::kFloat, 1.0);
+  nAttr.setKeyable(true);
+  nAttr.setMin(-1.0);
+  nAttr.setMax(1.0);
+  nAttr.setArray(true);
+  nAttr.setUsesArrayDataBuilder(true);
+  addAttribute(aSwingWeight);
+  attributeAffects(aSwingWeight, aOutMatrix);
+
+  aTwistAxis = eAttr.create("twistAxis", "twistAxis");
+  eAttr.setKeyable(true);
+  eAttr.addField("X", 0);
+  eAttr.addField("Y", 1);
+  eAttr.addField("Z", 2);
+  eAttr.setArray(true);
+  eAttr.setUsesArrayDataBuilder(true);
+  addAttribute(aTwistAxis);
+  attributeAffects(aTwistAxis, aOutMatrix);
+
+  return MS::kSuccess;
+}
+
+void* SwingTwistArrayNode::creator() { return new SwingTwistArrayNode(); }
+
+SwingTwistArrayNode::SwingTwistArrayNode() {}
+
+SwingTwistArrayNode::~SwingTwistArrayNode() {}
+
+MStatus SwingTwistArrayNode::compute(const MPlug& plug, MDataBlock& data) {
+  MStatus status;
+
+  if (plug != aOutMatrix) {
+    return MS::kUnknownParameter;
+  }
+
+  // Gather all the pairs first so the math can run in a single pass without touching the
+  // data block.  The driverMatrix elements define which pairs exist.  The buffers are local so
+  // the node can be evaluated in several contexts at once.
+  MArrayDataHandle hInMatrix = data.inputArrayValue(aInMatrix);
+  MArrayDataHandle hRestMatrix = data.inputArrayValue(aRestMatrix);
+  MArrayDataHandle hTargetRestMatrix = data.inputArrayValue(aTargetRestMatrix);
+  MArrayDataHandle hTwistWeight = data.inputArrayValue(aTwistWeight);
+  MArrayDataHandle hSwingWeight = data.inputArrayValue(aSwingWeight);
+  MArrayDataHandle hTwistAxis = data.inputArrayValue(aTwistAxis);
+
+  unsigned int count = hInMatrix.elementCount();
+  std::vector<unsigned int> indices(count);
+  MMatrixArray inMatrix(count);
+  MMatrixArray restMatrix(count);
+  MMatrixArray targetRestMatrix(count);
+  std::vector<float> twistWeight(count);
+  std::vector<float> swingWeight(count);
+  std::vector<short> twistAxis(count);
+  MMatrixArray outMatrix(count);
+  for (unsigned int i = 0; i < count; ++i) {
+    status = hInMatrix.jumpToArrayElement(i);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    unsigned int index = hInMatrix.elementIndex();
+    indices[i] = index;
+    inMatrix[i] = hInMatrix.inputValue().asMatrix();
+
+    status = JumpToElement(hRestMatrix, index);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    restMatrix[i] = hRestMatrix.inputValue().asMatrix();
+
+    status = JumpToElement(hTargetRestMatrix, index);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    targetRestMatrix[i] = hTargetRestMatrix.inputValue().asMatrix();
+
+    status = JumpToElement(hTwistWeight, index);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    twistWeight[i] = hTwistWeight.inputValue().asFloat();
+
+    status = JumpToElement(hSwingWeight, index);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    swingWeight[i] = hSwingWeight.inputValue().asFloat();
+
+    status = JumpToElement(hTwistAxis, index);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    twistAxis[i] = hTwistAxis.inputValue().asShort();
+  }
+
+#pragma omp parallel for if (count > 64)
+  for (int i = 0; i < (int)count; ++i) {
+    MQuaternion twist, swing;
+    SwingTwistNode::decompose(inMatrix[i], restMatrix[i], twistAxis[i], twist, swing);
+    outMatrix[i] = SwingTwistNode::weightedMatrix(twist, swing, twistWeight[i],
+                                                   swingWeight[i], targetRestMatrix[i]);
+  }
+
+  // Rebuild the output array so the outputs of removed pairs do not keep their last value
+  MArrayDataHandle hOutMatrix = data.outputArrayValue(aOutMatrix);
+  MArrayDataBuilder builder(&data, aOutMatrix, count, &status);
+  CHECK_MSTATUS_AND_RETURN_IT(status);
+  for (unsigned int i = 0; i < count; ++i) {
+    MDataHandle hOut = builder.addElement(indices[i], &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    hOut.setMMatrix(outMatrix[i]);
+  }
+  status = hOutMatrix.set(builder);
+  CHECK_MSTATUS_AND_RETURN_IT(status);
+  hOutMatrix.setAllClean();
+
+  return MS::kSuccess;
+}
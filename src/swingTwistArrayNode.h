@@ -0,0 +1,31 @@
+#ifndef SWINGTWIST_SWINGTWISTARRAYNODE_H
+#define SWINGTWIST_SWINGTWISTARRAYNODE_H
+
+#include <maya/MPxNode.h>
+
+/**
+  Multi-instance version of the swingTwist node.  Each logical index of the array attributes is
+  an independent driver/driven pair.  Evaluating many pairs in one node avoids the per node DG
+  overhead that dominates rigs with hundreds of swingTwist nodes.
+*/
+class SwingTwistArrayNode : public MPxNode {
+ public:
+  SwingTwistArrayNode();
+  virtual ~SwingTwistArrayNode();
+  static void* creator();
+
+  virtual MStatus compute(const MPlug& plug, MDataBlock& data);
+
+  static MStatus initialize();
+  static MTypeId id;
+  static const MString kName;
+  static MObject aOutMatrix;
+  static MObject aRestMatrix;
+  static MObject aTargetRestMatrix;
+  static MObject aInMatrix;
+  static MObject aTwistWeight;
+  static MObject aSwingWeight;
+  static MObject aTwistAxis;
+};
+
+#endif
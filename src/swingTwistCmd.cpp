@@ -1,4 +1,6 @@
 #include "swingTwistCmd.h"
+#include "common.h"
+#include "swingTwistArrayNode.h"
 #include "swingTwistNode.h"
 
 #include <maya/MDagPath.h>
@@ -6,6 +8,7 @@
 #include <maya/MFnMatrixData.h>
 #include <maya/MMatrix.h>
 #include <maya/MPlug.h>
+#include <maya/MSelectionList.h>
 
 const char* SwingTwistCmd::kNameShort = "-n";
 const char* SwingTwistCmd::kNameLong = "-name";
@@ -15,6 +18,8 @@ const char* SwingTwistCmd::kSwingShort = "-s";
 const char* SwingTwistCmd::kSwingLong = "-swing";
 const char* SwingTwistCmd::kTwistAxisShort = "-ta";
 const char* SwingTwistCmd::kTwistAxisLong = "-twistAxis";
+const char* SwingTwistCmd::kArrayShort = "-a";
+const char* SwingTwistCmd::kArrayLong = "-array";
 const MString SwingTwistCmd::kName("swingTwist");
 
 void* SwingTwistCmd::creator() { return new SwingTwistCmd; }
@@ -28,9 +33,18 @@ MSyntax SwingTwistCmd::newSyntax() {
   syntax.addFlag(kTwistShort, kTwistLong, MSyntax::kDouble);
   syntax.addFlag(kSwingShort, kSwingLong, MSyntax::kDouble);
   syntax.addFlag(kTwistAxisShort, kTwistAxisLong, MSyntax::kLong);
+  syntax.addFlag(kArrayShort, kArrayLong);
+  // Weights can be specified once for all pairs or once per pair
+  syntax.makeFlagMultiUse(kTwistShort);
+  syntax.makeFlagMultiUse(kSwingShort);
+  syntax.makeFlagMultiUse(kTwistAxisShort);
 
-  syntax.setObjectType(MSyntax::kSelectionList, 2, 2);
-  syntax.useSelectionAsDefault(true);
+  // Objects are a flat list of driver/driven pairs.  Each pair gets its own swingTwist node
+  // unless -array is used, in which case all pairs share one swingTwistArray node.  All nodes
+  // are created with a single MDGModifier so a batch is one undo step.  The objects are taken as
+  // names because a selection list would merge a driver shared by several pairs.  Maya only
+  // defaults selection list objects to the selection so doIt falls back to it.
+  syntax.setObjectType(MSyntax::kStringObjects, 0);
 
   syntax.enableEdit(false);
   syntax.enableQuery(false);
@@ -44,21 +58,92 @@ MStatus SwingTwistCmd::doIt(const MArgList& argList) {
   MArgDatabase argData(syntax(), argList, &status);
   CHECK_MSTATUS_AND_RETURN_IT(status);
 
-  MSelectionList selection;
-  status = argData.getObjects(selection);
+  MStringArray objects;
+  status = argData.getObjects(objects);
   CHECK_MSTATUS_AND_RETURN_IT(status);
+  if (objects.length() == 0) {
+    MSelectionList selection;
+    MGlobal::getActiveSelectionList(selection);
+    selection.getSelectionStrings(objects);
+  }
+
+  if (objects.length() < 2 || objects.length() % 2 != 0) {
+    MGlobal::displayError("swingTwist requires driver/driven pairs.");
+    return MS::kInvalidParameter;
+  }
+  pairCount_ = objects.length() / 2;
+  for (const char* flag : {kTwistShort, kSwingShort, kTwistAxisShort}) {
+    unsigned int uses = argData.numberOfFlagUses(flag);
+    if (uses > 1 && uses != pairCount_) {
+      MGlobal::displayError(MString(flag) + " must be specified once or once per pair.");
+      return MS::kInvalidParameter;
+    }
+  }
+  bool useArray = argData.isFlagSet(kArrayShort);
+  unsigned int nodeCount = useArray ? 1 : pairCount_;
 
-  // Get the name
+  // Get the name.  Batches of swingTwist nodes get a numbered suffix.
+  MString name;
   if (argData.isFlagSet(kNameShort)) {
-    name_ = argData.flagArgumentString(kNameShort, 0, &status);
+    name = argData.flagArgumentString(kNameShort, 0, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+  }
+  names_.clear();
+  oNodes_.clear();
+  for (unsigned int i = 0; i < nodeCount; ++i) {
+    MString nodeName = name;
+    if (name.length() && nodeCount > 1) {
+      nodeName += (i + 1);
+    }
+    names_.append(nodeName);
+
+    MObject oNode =
+        dgMod_.createNode(useArray ? SwingTwistArrayNode::id : SwingTwistNode::id, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    oNodes_.append(oNode);
+  }
+
+  for (unsigned int i = 0; i < pairCount_; ++i) {
+    MDagPath pathDriver, pathDriven;
+    status = getDagPath(objects[i * 2], pathDriver);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    status = getDagPath(objects[i * 2 + 1], pathDriven);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    if (useArray) {
+      status = connectPair(oNodes_[0], (int)i, i, pathDriver, pathDriven, argData);
+    } else {
+      status = connectPair(oNodes_[i], -1, i, pathDriver, pathDriven, argData);
+    }
     CHECK_MSTATUS_AND_RETURN_IT(status);
   }
-  oNode_ = dgMod_.createNode(SwingTwistNode::id, &status);
+
+  return redoIt();
+}
+
+MStatus SwingTwistCmd::getPairFlagValue(const MArgDatabase& argData, const char* flag,
+                                        unsigned int pair, double& value) {
+  MStatus status;
+  unsigned int uses = argData.numberOfFlagUses(flag);
+  MArgList args;
+  status = argData.getFlagArgumentList(flag, uses == 1 ? 0 : pair, args);
   CHECK_MSTATUS_AND_RETURN_IT(status);
+  value = args.asDouble(0, &status);
+  CHECK_MSTATUS_AND_RETURN_IT(status);
+  return MS::kSuccess;
+}
 
-  MDagPath pathDriver, pathDriven;
-  selection.getDagPath(0, pathDriver);
-  selection.getDagPath(1, pathDriven);
+MStatus SwingTwistCmd::connectPair(const MObject& oNode, int index, unsigned int pair,
+                                   const MDagPath& pathDriver, const MDagPath& pathDriven,
+                                   const MArgDatabase& argData) {
+  MStatus status;
+  MFnDependencyNode fnNode(oNode, &status);
+  CHECK_MSTATUS_AND_RETURN_IT(status);
+  // swingTwist and swingTwistArray share attribute names, the array node just has array
+  // attributes.
+  auto nodePlug = [&](const char* name) {
+    MPlug plug = fnNode.findPlug(name, false, &status);
+    return index < 0 ? plug : plug.elementByLogicalIndex(index);
+  };
 
   MFnDagNode fnDriver(pathDriver, &status);
   CHECK_MSTATUS_AND_RETURN_IT(status);
@@ -66,14 +151,14 @@ MStatus SwingTwistCmd::doIt(const MArgList& argList) {
   CHECK_MSTATUS_AND_RETURN_IT(status);
 
   // Connect the matrix
-  MPlug plugDriverMatrix(oNode_, SwingTwistNode::aInMatrix);
+  MPlug plugDriverMatrix = nodePlug("driverMatrix");
   MPlug plugMatrix = fnDriver.findPlug("matrix", false, &status);
   CHECK_MSTATUS_AND_RETURN_IT(status);
   dgMod_.connect(plugMatrix, plugDriverMatrix);
 
   // Set the driver rest matrix
   MMatrix driverRestMatrix = pathDriver.inclusiveMatrix() * pathDriver.exclusiveMatrixInverse();
-  MPlug plugDriverRestMatrix(oNode_, SwingTwistNode::aRestMatrix);
+  MPlug plugDriverRestMatrix = nodePlug("driverRestMatrix");
   MFnMatrixData fnMatrixData;
   MObject oRestMatrix = fnMatrixData.create(driverRestMatrix, &status);
   CHECK_MSTATUS_AND_RETURN_IT(status);
@@ -81,38 +166,39 @@ MStatus SwingTwistCmd::doIt(const MArgList& argList) {
 
   // Set the target rest matrix
   MMatrix targetRestMatrix = pathDriven.inclusiveMatrix() * pathDriven.exclusiveMatrixInverse();
-  MPlug plugDrivenRestMatrix(oNode_, SwingTwistNode::aTargetRestMatrix);
+  MPlug plugDrivenRestMatrix = nodePlug("targetRestMatrix");
   MObject oTargetRestMatrix = fnMatrixData.create(targetRestMatrix, &status);
   CHECK_MSTATUS_AND_RETURN_IT(status);
   dgMod_.newPlugValue(plugDrivenRestMatrix, oTargetRestMatrix);
 
   // Set the twist
+  double value;
   if (argData.isFlagSet(kTwistShort)) {
-    float twist = (float)(argData.flagArgumentDouble(kTwistShort, 0, &status));
+    status = getPairFlagValue(argData, kTwistShort, pair, value);
     CHECK_MSTATUS_AND_RETURN_IT(status);
-    MPlug plugTwist(oNode_, SwingTwistNode::aTwistWeight);
-    dgMod_.newPlugValueFloat(plugTwist, twist);
+    MPlug plugTwist = nodePlug("twist");
+    dgMod_.newPlugValueFloat(plugTwist, (float)value);
   }
 
   // Set the swing
   if (argData.isFlagSet(kSwingShort)) {
-    float swing = (float)(argData.flagArgumentDouble(kSwingShort, 0, &status));
+    status = getPairFlagValue(argData, kSwingShort, pair, value);
     CHECK_MSTATUS_AND_RETURN_IT(status);
-    MPlug plugSwing(oNode_, SwingTwistNode::aSwingWeight);
-    dgMod_.newPlugValueFloat(plugSwing, swing);
+    MPlug plugSwing = nodePlug("swing");
+    dgMod_.newPlugValueFloat(plugSwing, (float)value);
   }
 
   // Set the twist axis
   if (argData.isFlagSet(kTwistAxisShort)) {
-    short twistAxis = (short)(argData.flagArgumentInt(kTwistAxisShort, 0, &status));
+    status = getPairFlagValue(argData, kTwistAxisShort, pair, value);
     CHECK_MSTATUS_AND_RETURN_IT(status);
-    MPlug plugSwing(oNode_, SwingTwistNode::aTwistAxis);
-    dgMod_.newPlugValueShort(plugSwing, twistAxis);
+    MPlug plugTwistAxis = nodePlug("twistAxis");
+    dgMod_.newPlugValueShort(plugTwistAxis, (short)value);
   }
 
   // Connect the output
 #if MAYA_API_VERSION >= 20200000
-  MPlug plugOutMatrix(oNode_, SwingTwistNode::aOutMatrix);
+  MPlug plugOutMatrix = nodePlug("outMatrix");
   MPlug plugOffsetParentMatrix = fnDriven.findPlug("offsetParentMatrix", false, &status);
   CHECK_MSTATUS_AND_RETURN_IT(status);
   dgMod_.connect(plugOutMatrix, plugOffsetParentMatrix);
@@ -123,7 +209,7 @@ MStatus SwingTwistCmd::doIt(const MArgList& argList) {
                               "translateZ",
                               "rotateX",
                               "rotateY",
-                              "rotateZ"
+                              "rotateZ",
                               "jointOrientX",
                               "jointOrientY",
                               "jointOrientZ"};
@@ -135,7 +221,7 @@ MStatus SwingTwistCmd::doIt(const MArgList& argList) {
   }
 #endif
 
-  return redoIt();
+  return MS::kSuccess;
 }
 
 MStatus SwingTwistCmd::redoIt() {
@@ -144,16 +230,24 @@ MStatus SwingTwistCmd::redoIt() {
   status = dgMod_.doIt();
   CHECK_MSTATUS_AND_RETURN_IT(status);
 
-  MFnDependencyNode fnNode(oNode_, &status);
-  CHECK_MSTATUS_AND_RETURN_IT(status);
-  if (name_.length()) {
-    name_ = fnNode.setName(name_, &status);
+  MStringArray result;
+  for (unsigned int i = 0; i < oNodes_.length(); ++i) {
+    MFnDependencyNode fnNode(oNodes_[i], &status);
     CHECK_MSTATUS_AND_RETURN_IT(status);
-  } else {
-    name_ = fnNode.name();
+    MString name = fnNode.name();
+    if (names_[i].length()) {
+      name = fnNode.setName(names_[i], &status);
+      CHECK_MSTATUS_AND_RETURN_IT(status);
+    }
+    result.append(name);
   }
 
-  setResult(name_);
+  // A single node keeps returning a plain string for backwards compatibility
+  if (result.length() == 1) {
+    setResult(result[0]);
+  } else {
+    setResult(result);
+  }
 
   return MS::kSuccess;
 }
@@ -3,11 +3,14 @@
 
 #include <maya/MArgDatabase.h>
 #include <maya/MArgList.h>
+#include <maya/MDagPath.h>
 #include <maya/MDGModifier.h>
 #include <maya/MGlobal.h>
 #include <maya/MObject.h>
+#include <maya/MObjectArray.h>
 #include <maya/MPxCommand.h>
 #include <maya/MSelectionList.h>
+#include <maya/MStringArray.h>
 #include <maya/MSyntax.h>
 
 #include <iostream>
@@ -31,11 +34,39 @@ class SwingTwistCmd : public MPxCommand {
   static const char* kSwingLong;
   static const char* kTwistAxisShort;
   static const char* kTwistAxisLong;
+  static const char* kArrayShort;
+  static const char* kArrayLong;
 
 private:
+  /**
+    Connects a driver/driven pair to a swingTwist or swingTwistArray node.
+    @param[in] oNode The swingTwist or swingTwistArray node.
+    @param[in] index Logical index of the pair on a swingTwistArray node or -1 for a swingTwist
+      node.
+    @param[in] pair Index of the pair in the command arguments.
+    @param[in] pathDriver Path to the driver transform.
+    @param[in] pathDriven Path to the driven transform.
+    @param[in] argData Command arguments.
+  */
+  MStatus connectPair(const MObject& oNode, int index, unsigned int pair,
+                      const MDagPath& pathDriver, const MDagPath& pathDriven,
+                      const MArgDatabase& argData);
+
+  /**
+    Gets the value of a weight flag which can either be specified once for all pairs or once
+    per pair.
+    @param[in] argData Command arguments.
+    @param[in] flag Short flag name.
+    @param[in] pair Index of the pair in the command arguments.
+    @param[out] value Storage for the flag value.
+  */
+  MStatus getPairFlagValue(const MArgDatabase& argData, const char* flag, unsigned int pair,
+                           double& value);
+
   MDGModifier dgMod_;
-  MString name_;
-  MObject oNode_;
+  MStringArray names_;
+  MObjectArray oNodes_;
+  unsigned int pairCount_;
 
 };
 
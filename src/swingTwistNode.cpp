@@ -1,13 +1,18 @@
 #include "swingTwistNode.h"
 
+#include <maya/MArrayDataHandle.h>
 #include <maya/MFloatVector.h>
 #include <maya/MFnEnumAttribute.h>
 #include <maya/MFnMatrixAttribute.h>
 #include <maya/MFnNumericAttribute.h>
 #include <maya/MMatrix.h>
+#include <maya/MPlug.h>
 #include <maya/MQuaternion.h>
+#include <maya/MRampAttribute.h>
 #include <maya/MTransformationMatrix.h>
 
+#include "common.h"
+
 
 MTypeId SwingTwistNode::id(0x00115819);
 MObject SwingTwistNode::aOutMatrix;
@@ -17,6 +22,11 @@ MObject SwingTwistNode::aRestMatrix;
 MObject SwingTwistNode::aTwistWeight;
 MObject SwingTwistNode::aSwingWeight;
 MObject SwingTwistNode::aTwistAxis;
+MObject SwingTwistNode::aDistributionOutMatrix;
+MObject SwingTwistNode::aDistributionTargetRestMatrix;
+MObject SwingTwistNode::aDistributionWeight;
+MObject SwingTwistNode::aUseDistributionFalloff;
+MObject SwingTwistNode::aDistributionFalloff;
 
 
 const MString SwingTwistNode::kName("swingTwist");
@@ -33,24 +43,62 @@ MStatus SwingTwistNode::initialize() {
   mAttr.setStorable(false);
   addAttribute(aOutMatrix);
 
+  aDistributionOutMatrix = mAttr.create("distributionOutMatrix", "distributionOutMatrix");
+  mAttr.setArray(true);
+  mAttr.setUsesArrayDataBuilder(true);
+  mAttr.setWritable(false);
+  mAttr.setStorable(false);
+  addAttribute(aDistributionOutMatrix);
+
   aInMatrix = mAttr.create("driverMatrix", "driverMatrix");
   addAttribute(aInMatrix);
   attributeAffects(aInMatrix, aOutMatrix);
+  attributeAffects(aInMatrix, aDistributionOutMatrix);
 
   aRestMatrix = mAttr.create("driverRestMatrix", "driverRestMatrix");
   addAttribute(aRestMatrix);
   attributeAffects(aRestMatrix, aOutMatrix);
+  attributeAffects(aRestMatrix, aDistributionOutMatrix);
 
   aTargetRestMatrix = mAttr.create("targetRestMatrix", "targetRestMatrix");
   addAttribute(aTargetRestMatrix);
   attributeAffects(aTargetRestMatrix, aOutMatrix);
 
+  aDistributionTargetRestMatrix =
+      mAttr.create("distributionTargetRestMatrix", "distributionTargetRestMatrix");
+  mAttr.setArray(true);
+  mAttr.setUsesArrayDataBuilder(true);
+  addAttribute(aDistributionTargetRestMatrix);
+  attributeAffects(aDistributionTargetRestMatrix, aDistributionOutMatrix);
+
+  aDistributionWeight =
+      nAttr.create("distributionWeight", "distributionWeight", MFnNumericData::kFloat, 1.0);
+  nAttr.setKeyable(true);
+  nAttr.setMin(-1.0);
+  nAttr.setMax(1.0);
+  nAttr.setArray(true);
+  nAttr.setUsesArrayDataBuilder(true);
+  addAttribute(aDistributionWeight);
+  attributeAffects(aDistributionWeight, aDistributionOutMatrix);
+
+  aUseDistributionFalloff = nAttr.create("useDistributionFalloff", "useDistributionFalloff",
+                                         MFnNumericData::kBoolean, false);
+  nAttr.setKeyable(true);
+  addAttribute(aUseDistributionFalloff);
+  attributeAffects(aUseDistributionFalloff, aDistributionOutMatrix);
+
+  aDistributionFalloff =
+      MRampAttribute::createCurveRamp("distributionFalloff", "distributionFalloff");
+  addAttribute(aDistributionFalloff);
+  attributeAffects(aDistributionFalloff, aDistributionOutMatrix);
+
   aTwistWeight = nAttr.create("twist", "twist", MFnNumericData::kFloat, 1.0);
   nAttr.setKeyable(true);
   nAttr.setMin(-1.0);
   nAttr.setMax(1.0);
   addAttribute(aTwistWeight);
   attributeAffects(aTwistWeight, aOutMatrix);
+  attributeAffects(aTwistWeight, aDistributionOutMatrix);
 
   aSwingWeight = nAttr.create("swing", "swing", MFnNumericData::kFloat, 1.0);
   nAttr.setKeyable(true);
@@ -58,6 +106,7 @@ MStatus SwingTwistNode::initialize() {
   nAttr.setMax(1.0);
   addAttribute(aSwingWeight);
   attributeAffects(aSwingWeight, aOutMatrix);
+  attributeAffects(aSwingWeight, aDistributionOutMatrix);
 
   aTwistAxis = eAttr.create("twistAxis", "twistAxis");
   eAttr.setKeyable(true);
@@ -66,6 +115,7 @@ MStatus SwingTwistNode::initialize() {
   eAttr.addField("Z", 2);
   addAttribute(aTwistAxis);
   attributeAffects(aTwistAxis, aOutMatrix);
+  attributeAffects(aTwistAxis, aDistributionOutMatrix);
 
   return MS::kSuccess;
 }
@@ -87,25 +137,81 @@ SwingTwistNode::~SwingTwistNode() {
 MStatus SwingTwistNode::compute(const MPlug &plug, MDataBlock &data) {
   MStatus status;
 
-  if (plug != aOutMatrix) {
+  MPlug requested = plug.isElement() ? plug.array() : plug;
+  if (requested != aOutMatrix && requested != aDistributionOutMatrix) {
     return MS::kUnknownParameter;
   }
 
   // Get the input data
   MMatrix inMatrix = data.inputValue(aInMatrix).asMatrix();
-  MMatrix targetRestMatrix = data.inputValue(aTargetRestMatrix).asMatrix();
   MMatrix restMatrix = data.inputValue(aRestMatrix).asMatrix();
   float twistWeight = data.inputValue(aTwistWeight).asFloat();
   float swingWeight = data.inputValue(aSwingWeight).asFloat();
   short twistAxis = data.inputValue(aTwistAxis).asShort();
 
+  // The decomposition is shared by outMatrix and all the distribution outputs
+  MQuaternion twist, swing;
+  decompose(inMatrix, restMatrix, twistAxis, twist, swing);
+
+  if (requested == aOutMatrix) {
+    MMatrix targetRestMatrix = data.inputValue(aTargetRestMatrix).asMatrix();
+    MMatrix outMatrix = weightedMatrix(twist, swing, twistWeight, swingWeight, targetRestMatrix);
+
+    MDataHandle hOut = data.outputValue(aOutMatrix);
+    hOut.setMMatrix(outMatrix);
+    hOut.setClean();
+    return MS::kSuccess;
+  }
+
+  // Distribution mode: each distributionTargetRestMatrix element gets its own output with the
+  // twist and swing weights scaled by the element weight or by the falloff curve sampled at
+  // (i + 1) / count so the last output receives the full weight.
+  bool useFalloff = data.inputValue(aUseDistributionFalloff).asBool();
+  MRampAttribute falloff(thisMObject(), aDistributionFalloff, &status);
+  CHECK_MSTATUS_AND_RETURN_IT(status);
+  MArrayDataHandle hTargetRestMatrix = data.inputArrayValue(aDistributionTargetRestMatrix);
+  MArrayDataHandle hWeight = data.inputArrayValue(aDistributionWeight);
+  MArrayDataHandle hOutMatrix = data.outputArrayValue(aDistributionOutMatrix);
+  unsigned int count = hTargetRestMatrix.elementCount();
+  for (unsigned int i = 0; i < count; ++i) {
+    status = hTargetRestMatrix.jumpToArrayElement(i);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    unsigned int index = hTargetRestMatrix.elementIndex();
+    MMatrix targetRestMatrix = hTargetRestMatrix.inputValue().asMatrix();
+
+    float weight = 1.0f;
+    if (useFalloff) {
+      falloff.getValueAtPosition((float)(i + 1) / (float)count, weight, &status);
+      CHECK_MSTATUS_AND_RETURN_IT(status);
+    } else {
+      status = JumpToElement(hWeight, index);
+      CHECK_MSTATUS_AND_RETURN_IT(status);
+      weight = hWeight.inputValue().asFloat();
+    }
+
+    MMatrix outMatrix = weightedMatrix(twist, swing, twistWeight * weight, swingWeight * weight,
+                                       targetRestMatrix);
+    status = JumpToElement(hOutMatrix, index);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    MDataHandle hOut = hOutMatrix.outputValue();
+    hOut.setMMatrix(outMatrix);
+    hOut.setClean();
+  }
+  hOutMatrix.setAllClean();
+
+  return MS::kSuccess;
+}
+
+
+void SwingTwistNode::decompose(const MMatrix& inMatrix, const MMatrix& restMatrix,
+                               short twistAxis, MQuaternion& twist, MQuaternion& swing) {
   // By calculating the local matrix with the world and parent inverse, we automatically
   // take in to account whether the joint uses joint orient or not.
   MMatrix localMatrix = inMatrix * restMatrix.inverse();
 
   // Get the input rotation quaternion
   MQuaternion rotation = MTransformationMatrix(localMatrix).rotation();
-  MQuaternion twist(rotation);
+  twist = rotation;
 
   // Get the reference twist vector
   switch (twistAxis) {
@@ -124,8 +230,12 @@ MStatus SwingTwistNode::compute(const MPlug &plug, MDataBlock &data) {
   }
   twist.normalizeIt();
 
-  MQuaternion swing = twist.inverse() * rotation;
+  swing = twist.inverse() * rotation;
+}
+
 
+MMatrix SwingTwistNode::weightedMatrix(MQuaternion twist, MQuaternion swing, float twistWeight,
+                                       float swingWeight, const MMatrix& targetRestMatrix) {
   if (twistWeight < 0.0f) {
     twist.invertIt();
     twistWeight = -twistWeight;
@@ -145,11 +255,5 @@ MStatus SwingTwistNode::compute(const MPlug &plug, MDataBlock &data) {
   // Since this is meant to drive offsetParentMatrix, we need to put the rotation
   // in the space of the driven transform. If we don't multiply by the target's rest
   // matrix, the rotation would occur in the target's parent space
-  MMatrix outMatrix = outRotation.asMatrix() * targetRestMatrix;
-
-  MDataHandle hOut = data.outputValue(aOutMatrix);
-  hOut.setMMatrix(outMatrix);
-  hOut.setClean();
-
-  return MS::kSuccess;
+  return outRotation.asMatrix() * targetRestMatrix;
 }
@@ -1,7 +1,9 @@
 #ifndef SWINGTWIST_SWINGTWISTNODE_H
 #define SWINGTWIST_SWINGTWISTNODE_H
 
+#include <maya/MMatrix.h>
 #include <maya/MPxNode.h>
+#include <maya/MQuaternion.h>
 
 class SwingTwistNode : public MPxNode {
  public:
@@ -21,6 +23,35 @@ class SwingTwistNode : public MPxNode {
   static MObject aTwistWeight;
   static MObject aSwingWeight;
   static MObject aTwistAxis;
+  // Distribution mode outputs several weighted copies of the same decomposition
+  static MObject aDistributionOutMatrix;
+  static MObject aDistributionTargetRestMatrix;
+  static MObject aDistributionWeight;
+  static MObject aUseDistributionFalloff;
+  static MObject aDistributionFalloff;
+
+  /**
+    Decomposes the local rotation of a driver in to twist and swing.
+    @param[in] inMatrix Driver matrix.
+    @param[in] restMatrix Driver rest matrix.
+    @param[in] twistAxis 0, 1, 2 for X, Y, Z.
+    @param[out] twist Twist rotation around twistAxis.
+    @param[out] swing Remaining swing rotation.
+  */
+  static void decompose(const MMatrix& inMatrix, const MMatrix& restMatrix, short twistAxis,
+                        MQuaternion& twist, MQuaternion& swing);
+
+  /**
+    Scales a decomposed swing and twist and puts the result in the space of the driven transform.
+    @param[in] twist Twist from decompose.
+    @param[in] swing Swing from decompose.
+    @param[in] twistWeight -1 to 1 twist scalar.
+    @param[in] swingWeight -1 to 1 swing scalar.
+    @param[in] targetRestMatrix Rest matrix of the driven transform.
+    @return The matrix to drive the offsetParentMatrix of the driven transform.
+  */
+  static MMatrix weightedMatrix(MQuaternion twist, MQuaternion swing, float twistWeight,
+                                float swingWeight, const MMatrix& targetRestMatrix);
 };
 
 #endif
@@ -0,0 +1,553 @@
+/**
+  Benchmarks the DemBones solver kernels on a synthetic model.  Does not require Maya.
+
+  Usage:
+    demBonesBenchmark [-vertices n] [-bones n] [-nnz n] [-frames n] [-threads 1,2,4,...]
+                      [-repeat n] [-kernel name] [-ratios 1,0.25,...] [-iters n] [-refine n]
+                      [-candidates n] [-iterativeSmooth 0|1] [-budgets 0,50,20,...]
+
+  The model is a grid of vertices skinned to its nearest bones and animated with random rigid
+  bone transformations.  Each selected kernel is run -repeat times for every thread count and
+  the best time is reported together with the speed up over the first thread count and a hash
+  of the kernel output.  The weights and smooth hashes must not change with the thread count.
+  uuT sums per-thread partials so its last bits depend on the thread count.  Configure with
+  -DCMAKE_BUILD_TYPE=Release for meaningful numbers.
+
+  -iterativeSmooth sets DemBones::iterativeSmooth for the smooth, ws and weights kernels.  The
+  ws kernel starts from the smoothed weights of the previous run like consecutive weights
+  iterations do.
+
+  -candidates sets DemBones::nCandidates.  The weights kernel also reports the RMSE so runs with
+  and without candidates can be compared.
+
+  The multires kernel instead runs a complete decomposition from scratch for each of the
+  -ratios with DemBones::computeMultiRes, -iters coarse and -refine full resolution iterations,
+  using the first thread count, and reports the time and the full resolution RMSE.  Ratio 1 is
+  the plain full resolution solve.
+
+  The frames kernel runs a complete decomposition from scratch for each of the -budgets with
+  DemBones::computeFrameBudget and -iters iterations, using the first thread count, and reports
+  the time and the RMSE over all the frames.  Budget 0 is the plain solve of all the frames.
+
+  The init kernel runs DemBones::init from scratch with each DemBones::initMethod, using the
+  first thread count, and reports the time, the RMSE of the rigid initialization and the
+  number of bones it found.
+
+  The vuT, mTm and aTb kernels are the dense products of the transformations and weights
+  updates.  aTb is computed for the bones each vertex is skinned to and excludes the mTm it
+  depends on.
+
+  Kernels:
+    uuT      DemBones::compute_uuT
+    vuT      DemBones::compute_vuT
+    mTm      DemBones::compute_mTm
+    label    DemBones::computeLabel from the largest weight of each vertex
+    aTb      DemBones::compute_aTb for the skinned bones of every vertex
+    weights  One DemBones::computeWeights iteration
+    smooth   DemBones::computeSmoothSolver
+    ws       DemBones::compute_ws
+    multires DemBones::computeMultiRes against a full solve
+    frames   DemBones::computeFrameBudget against a solve of all the frames
+    init     DemBones::init with LBG-VQ splitting against k-means++
+*/
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "DemBones/DemBones.h"
+
+#ifndef DEM_BONES_MAT_BLOCKS
+#include "DemBones/MatBlocks.h"
+#endif
+
+struct Options {
+  Options()
+      : vertices(100000),
+        bones(100),
+        nnz(8),
+        frames(10),
+        repeat(3),
+        iters(10),
+        refine(2),
+        candidates(0),
+        iterativeSmooth(false) {}
+  int vertices;
+  int bones;
+  int nnz;
+  int frames;
+  int repeat;
+  int iters;
+  int refine;
+  int candidates;
+  bool iterativeSmooth;
+  std::vector<int> threads;
+  std::vector<std::string> kernels;
+  std::vector<double> ratios;
+  std::vector<int> budgets;
+};
+
+/**
+  Exposes the protected solver kernels to the benchmark.
+*/
+class BenchmarkModel : public Dem::DemBones<double, float> {
+ public:
+  /**
+    Builds a synthetic skinned and animated grid.
+    @param[in] options Model dimensions.
+  */
+  void build(const Options& options) {
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+
+    int width = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(options.vertices))));
+    int height = (options.vertices + width - 1) / width;
+    nV = width * height;
+    nB = options.bones;
+    nS = 1;
+    nF = options.frames;
+    nnz = options.nnz;
+    fStart.resize(2);
+    fStart << 0, nF;
+    subjectID = Eigen::VectorXi::Zero(nF);
+
+    u.resize(3, nV);
+    for (int y = 0; y < height; ++y) {
+      for (int x = 0; x < width; ++x) {
+        u.col(y * width + x) << x / static_cast<double>(width), y / static_cast<double>(height),
+            0.0;
+      }
+    }
+    fv.clear();
+    for (int y = 0; y + 1 < height; ++y) {
+      for (int x = 0; x + 1 < width; ++x) {
+        int i = y * width + x;
+        fv.push_back({i, i + 1, i + width + 1, i + width});
+      }
+    }
+
+    // Skin each vertex to its nearest bones with inverse distance weights
+    MatrixX centers(3, nB);
+    for (int j = 0; j < nB; ++j) {
+      centers.col(j) << 0.5 + 0.5 * uniform(rng), 0.5 + 0.5 * uniform(rng), 0.0;
+    }
+    int influences = std::min(nnz, nB);
+    std::vector<Triplet, Eigen::aligned_allocator<Triplet>> triplets;
+    std::vector<std::pair<double, int>> distances(nB);
+    for (int i = 0; i < nV; ++i) {
+      for (int j = 0; j < nB; ++j) {
+        distances[j] = std::make_pair((centers.col(j) - u.col(i)).norm() + 1e-6, j);
+      }
+      std::partial_sort(distances.begin(), distances.begin() + influences, distances.end());
+      double sum = 0.0;
+      for (int k = 0; k < influences; ++k) {
+        sum += 1.0 / distances[k].first;
+      }
+      for (int k = 0; k < influences; ++k) {
+        triplets.push_back(Triplet(distances[k].second, i, 1.0 / distances[k].first / sum));
+      }
+    }
+    w.resize(nB, nV);
+    w.setFromTriplets(triplets.begin(), triplets.end());
+
+    // Random rigid bone animation
+    m.resize(nF * 4, nB * 4);
+    for (int k = 0; k < nF; ++k) {
+      for (int j = 0; j < nB; ++j) {
+        Eigen::Quaterniond q(uniform(rng), uniform(rng), uniform(rng), uniform(rng));
+        Matrix4 mat = Matrix4::Identity();
+        mat.topLeftCorner<3, 3>() = q.normalized().toRotationMatrix();
+        mat.topRightCorner<3, 1>() << 0.1 * uniform(rng), 0.1 * uniform(rng), 0.1 * uniform(rng);
+        m.blk4(k, j) = mat;
+      }
+    }
+    resizeV(3 * nF, nV);
+    for (int i = 0; i < nV; ++i) {
+      for (int k = 0; k < nF; ++k) {
+        Vector3 p = Vector3::Zero();
+        for (SparseMatrix::InnerIterator it(w, i); it; ++it) {
+          p += it.value() * (m.rotMat(k, it.row()) * u.col(i) + m.transVec(k, it.row()));
+        }
+        v.vec3(k, i) = p.cast<float>();
+      }
+    }
+    nWeightsIters = 1;
+    nCandidates = options.candidates;
+    iterativeSmooth = options.iterativeSmooth;
+    init();
+    restWeights_ = w;
+  }
+
+  /**
+    Restores the weights the model was built with so repeated weight solves do the same work.
+  */
+  void resetWeights() { w = restWeights_; }
+
+  /**
+    Labels each vertex with its largest weight so repeated label solves start from the same labels.
+  */
+  void resetLabels() {
+    label = Eigen::VectorXi::Constant(nV, -1);
+    for (int i = 0; i < nV; ++i) {
+      double largest = 0.0;
+      for (SparseMatrix::InnerIterator it(w, i); it; ++it) {
+        if (it.value() > largest) {
+          largest = it.value();
+          label(i) = static_cast<int>(it.row());
+        }
+      }
+    }
+  }
+
+  /**
+    Drops the weights and transformations so compute starts with the bone initialization.
+    @param[in] iterations Number of global iterations.
+  */
+  void resetSolve(int iterations) {
+    w.resize(0, 0);
+    m.resize(0, 0);
+    laplacian.resize(0, 0);
+    nIters = iterations;
+    nWeightsIters = 3;
+  }
+
+  /**
+    @return FNV-1a hash of the bits of a set of values.
+  */
+  static uint64_t hash(const double* values, size_t count) {
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < count; ++i) {
+      uint64_t bits;
+      std::memcpy(&bits, values + i, sizeof(bits));
+      h = (h ^ bits) * 1099511628211ull;
+    }
+    return h;
+  }
+
+  /**
+    Computes aTb for the bones each vertex is skinned to, the way computeWeights() does.
+    compute_mTm() must have been called.
+  */
+  void computeSkinnedATb() {
+    aTb = MatrixX::Zero(nB, nV);
+#pragma omp parallel for
+    for (int i = 0; i < nV; ++i) {
+      Eigen::VectorXi bones(w.col(i).nonZeros());
+      int c = 0;
+      for (SparseMatrix::InnerIterator it(w, i); it; ++it) {
+        bones(c++) = static_cast<int>(it.row());
+      }
+      compute_aTb(i, bones);
+    }
+  }
+
+  uint64_t uuTHash() const { return hash(uuT.val.data(), uuT.val.size()); }
+  uint64_t vuTHash() const { return hash(vuT.data(), vuT.size()); }
+  uint64_t mTmHash() const { return hash(mTm.data(), mTm.size()); }
+  uint64_t labelHash() const {
+    Eigen::VectorXd values = label.cast<double>();
+    return hash(values.data(), values.size());
+  }
+  uint64_t aTbHash() const { return hash(aTb.data(), aTb.size()); }
+  uint64_t weightsHash() const { return hash(w.valuePtr(), w.nonZeros()); }
+  uint64_t wsHash() const { return hash(ws.data(), ws.size()); }
+  uint64_t laplacianHash() const { return hash(laplacian.valuePtr(), laplacian.nonZeros()); }
+
+  using Dem::DemBones<double, float>::compute_uuT;
+  using Dem::DemBones<double, float>::compute_vuT;
+  using Dem::DemBones<double, float>::compute_mTm;
+  using Dem::DemBones<double, float>::computeLabel;
+  using Dem::DemBones<double, float>::computeSmoothSolver;
+  using Dem::DemBones<double, float>::compute_ws;
+
+ private:
+  SparseMatrix restWeights_;
+};
+
+static void usage() {
+  std::cerr << "Usage: demBonesBenchmark [-vertices n] [-bones n] [-nnz n] [-frames n] "
+               "[-threads 1,2,4,...] [-repeat n] [-kernel name] [-ratios 1,0.25,...] "
+               "[-iters n] [-refine n] [-candidates n] [-iterativeSmooth 0|1] "
+               "[-budgets 0,50,20,...]"
+            << std::endl;
+}
+
+static std::vector<int> parseList(const std::string& value) {
+  std::vector<int> values;
+  std::stringstream stream(value);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    values.push_back(std::atoi(item.c_str()));
+  }
+  return values;
+}
+
+static std::vector<double> parseDoubleList(const std::string& value) {
+  std::vector<double> values;
+  std::stringstream stream(value);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    values.push_back(std::atof(item.c_str()));
+  }
+  return values;
+}
+
+static bool parseArguments(int argc, char* argv[], Options& options) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      std::cerr << arg << " requires a value" << std::endl;
+      return false;
+    }
+    std::string value = argv[++i];
+    if (arg == "-vertices") {
+      options.vertices = std::atoi(value.c_str());
+    } else if (arg == "-bones") {
+      options.bones = std::atoi(value.c_str());
+    } else if (arg == "-nnz") {
+      options.nnz = std::atoi(value.c_str());
+    } else if (arg == "-frames") {
+      options.frames = std::atoi(value.c_str());
+    } else if (arg == "-repeat") {
+      options.repeat = std::max(1, std::atoi(value.c_str()));
+    } else if (arg == "-threads") {
+      options.threads = parseList(value);
+    } else if (arg == "-kernel") {
+      options.kernels.push_back(value);
+    } else if (arg == "-ratios") {
+      options.ratios = parseDoubleList(value);
+    } else if (arg == "-iters") {
+      options.iters = std::max(1, std::atoi(value.c_str()));
+    } else if (arg == "-refine") {
+      options.refine = std::max(0, std::atoi(value.c_str()));
+    } else if (arg == "-candidates") {
+      options.candidates = std::max(0, std::atoi(value.c_str()));
+    } else if (arg == "-iterativeSmooth") {
+      options.iterativeSmooth = std::atoi(value.c_str()) != 0;
+    } else if (arg == "-budgets") {
+      options.budgets = parseList(value);
+    } else {
+      std::cerr << "Unknown flag " << arg << std::endl;
+      return false;
+    }
+  }
+  if (options.vertices <= 0 || options.bones <= 0 || options.frames <= 0) {
+    return false;
+  }
+  if (options.threads.empty()) {
+    options.threads = {1, 2, 4, 8, 16, 32};
+  }
+  if (options.kernels.empty()) {
+    options.kernels.push_back("uuT");
+  }
+  if (options.ratios.empty()) {
+    options.ratios = {1.0, 0.25, 0.1};
+  }
+  if (options.budgets.empty()) {
+    options.budgets = {0, options.frames / 2, options.frames / 5};
+  }
+  return true;
+}
+
+/**
+  Runs complete decompositions at each ratio and compares them to the full resolution solve.
+*/
+static void runMultiRes(const Options& options) {
+  std::cout << "multires" << std::endl;
+#ifdef _OPENMP
+  omp_set_num_threads(std::max(1, options.threads[0]));
+#endif
+  double baseline = 0.0;
+  for (double ratio : options.ratios) {
+    BenchmarkModel model;
+    model.build(options);
+    model.resetSolve(options.iters);
+    auto start = std::chrono::steady_clock::now();
+    bool success = model.computeMultiRes(ratio, options.refine);
+    double seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (baseline == 0.0) {
+      baseline = seconds;
+    }
+    std::cout << "  ratio " << std::fixed << std::setprecision(3) << ratio << ": ";
+    if (!success) {
+      std::cout << "initialization failed" << std::endl;
+      continue;
+    }
+    std::cout << std::setprecision(4) << seconds << "s  x" << std::setprecision(2)
+              << baseline / seconds << "  rmse " << std::scientific << std::setprecision(4)
+              << model.rmse() << std::defaultfloat << "  bones " << model.nB << std::endl;
+  }
+}
+
+/**
+  Runs complete decompositions on each frame budget and compares them to solving all the frames.
+*/
+static void runFrames(const Options& options) {
+  std::cout << "frames" << std::endl;
+#ifdef _OPENMP
+  omp_set_num_threads(std::max(1, options.threads[0]));
+#endif
+  double baseline = 0.0;
+  for (int budget : options.budgets) {
+    BenchmarkModel model;
+    model.build(options);
+    model.resetSolve(options.iters);
+    auto start = std::chrono::steady_clock::now();
+    bool success = model.computeFrameBudget(budget);
+    double seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (baseline == 0.0) {
+      baseline = seconds;
+    }
+    std::cout << "  budget " << std::setw(5) << budget << ": ";
+    if (!success) {
+      std::cout << "initialization failed" << std::endl;
+      continue;
+    }
+    std::cout << std::fixed << std::setprecision(4) << seconds << "s  x" << std::setprecision(2)
+              << baseline / seconds << "  rmse " << std::scientific << std::setprecision(4)
+              << model.rmse() << std::defaultfloat << "  bones " << model.nB << std::endl;
+  }
+}
+
+/**
+  Initializes the bones from scratch with each DemBones::initMethod.
+*/
+static void runInit(const Options& options) {
+  std::cout << "init" << std::endl;
+#ifdef _OPENMP
+  omp_set_num_threads(std::max(1, options.threads[0]));
+#endif
+  const char* names[] = {"split", "kmeans"};
+  for (int method = 0; method < 2; ++method) {
+    BenchmarkModel model;
+    model.build(options);
+    model.resetSolve(options.iters);
+    model.initMethod = method;
+    auto start = std::chrono::steady_clock::now();
+    bool success = model.init();
+    double seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "  " << std::setw(6) << names[method] << ": ";
+    if (!success) {
+      std::cout << "initialization failed" << std::endl;
+      continue;
+    }
+    std::cout << std::fixed << std::setprecision(4) << seconds << "s  rmse " << std::scientific
+              << std::setprecision(4) << model.rmse() << std::defaultfloat << "  bones "
+              << model.nB << std::endl;
+  }
+}
+
+int main(int argc, char* argv[]) {
+  Options options;
+  if (!parseArguments(argc, argv, options)) {
+    usage();
+    return 1;
+  }
+#ifndef _OPENMP
+  std::cout << "Built without OpenMP, all runs are single threaded" << std::endl;
+#endif
+
+  BenchmarkModel model;
+  model.build(options);
+  std::cout << model.nV << " vertices, " << model.nB << " bones, " << options.nnz
+            << " influences, " << model.nF << " frames" << std::endl;
+
+  for (const std::string& kernel : options.kernels) {
+    if (kernel == "multires") {
+      runMultiRes(options);
+      continue;
+    }
+    if (kernel == "init") {
+      runInit(options);
+      continue;
+    }
+    if (kernel == "frames") {
+      runFrames(options);
+      continue;
+    }
+    std::function<void()> run;
+    std::function<uint64_t()> hash;
+    bool reportError = false;
+    if (kernel == "uuT") {
+      run = [&model]() { model.compute_uuT(); };
+      hash = [&model]() { return model.uuTHash(); };
+    } else if (kernel == "vuT") {
+      run = [&model]() { model.compute_vuT(); };
+      hash = [&model]() { return model.vuTHash(); };
+    } else if (kernel == "mTm") {
+      run = [&model]() { model.compute_mTm(); };
+      hash = [&model]() { return model.mTmHash(); };
+    } else if (kernel == "aTb") {
+      model.compute_mTm();
+      run = [&model]() { model.computeSkinnedATb(); };
+      hash = [&model]() { return model.aTbHash(); };
+    } else if (kernel == "label") {
+      model.computeSmoothSolver();
+      run = [&model]() {
+        model.resetLabels();
+        model.computeLabel();
+      };
+      hash = [&model]() { return model.labelHash(); };
+    } else if (kernel == "weights") {
+      run = [&model]() {
+        model.resetWeights();
+        model.computeWeights();
+      };
+      hash = [&model]() { return model.weightsHash(); };
+      reportError = true;
+    } else if (kernel == "smooth") {
+      run = [&model]() { model.computeSmoothSolver(); };
+      hash = [&model]() { return model.laplacianHash(); };
+    } else if (kernel == "ws") {
+      run = [&model]() { model.compute_ws(); };
+      hash = [&model]() { return model.wsHash(); };
+    } else {
+      std::cerr << "Unknown kernel " << kernel << std::endl;
+      return 1;
+    }
+
+    std::cout << kernel << std::endl;
+    double baseline = 0.0;
+    for (int threads : options.threads) {
+#ifdef _OPENMP
+      omp_set_num_threads(std::max(1, threads));
+#endif
+      double best = 0.0;
+      for (int r = 0; r < options.repeat; ++r) {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        double seconds =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = r == 0 ? seconds : std::min(best, seconds);
+      }
+      if (baseline == 0.0) {
+        baseline = best;
+      }
+      std::cout << "  " << std::setw(3) << threads << " threads: " << std::fixed
+                << std::setprecision(4) << best << "s  x" << std::setprecision(2)
+                << baseline / best << "  hash " << std::hex << hash() << std::dec;
+      if (reportError) {
+        std::cout << "  rmse " << std::scientific << std::setprecision(4) << model.rmse()
+                  << std::defaultfloat;
+      }
+      std::cout << std::endl;
+    }
+  }
+  return 0;
+}
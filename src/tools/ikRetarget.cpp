@@ -0,0 +1,263 @@
+/**
+  Offline batch retarget using the ikRig solver.  Does not require Maya.
+
+  Usage:
+    ikRetarget -target targetRest.cmtm [-output dir] [-threads n] [-strideScale f]
+               [-rootMotionScale f] [-leftLegTwistOffset f] [-rightLegTwistOffset f]
+               [-repeat n] [-benchmark] clip.cmtm [clip.cmtm ...]
+
+  Each clip is a matrix stream (see matrixStream.h) holding the source rest pose and the source
+  animation of the IKRigPart joints, in IKRigPart order.  The target file holds the rest pose of
+  the target skeleton.  Each retargeted clip is written to the output directory with the same
+  file name and holds IKRig_Count + 1 matrices per frame: the world matrices of the target parts
+  followed by the root motion.  Clips from different directories with the same file name get a
+  _1, _2, ... suffix in the order they are listed.
+
+  Clips are processed in parallel by a pool of worker threads pulling from a shared work queue.
+  -benchmark skips writing the results and -repeat processes the clip list multiple times to
+  measure solver throughput in clips per minute.  Only the first repeat writes its results.
+*/
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ikRigSolver.h"
+#include "matrixStream.h"
+
+struct Options {
+  Options() : threads(std::thread::hardware_concurrency()), repeat(1), benchmark(false) {}
+  std::string targetPath;
+  std::string outputDirectory;
+  std::vector<std::string> clips;
+  IKRigParameters parameters;
+  unsigned int threads;
+  unsigned int repeat;
+  bool benchmark;
+};
+
+/**
+  Work queue shared by the worker threads.  Jobs are indices in to the clip list.
+*/
+class WorkQueue {
+ public:
+  explicit WorkQueue(size_t count) : next_(0), count_(count) {}
+
+  /**
+    Gets the next job.
+    @param[out] job Storage for the job index.
+    @return false when the queue is empty.
+  */
+  bool pop(size_t& job) {
+    job = next_++;
+    return job < count_;
+  }
+
+ private:
+  std::atomic<size_t> next_;
+  size_t count_;
+};
+
+static void usage() {
+  std::cerr << "Usage: ikRetarget -target targetRest.cmtm [-output dir] [-threads n] "
+               "[-strideScale f] [-rootMotionScale f] [-leftLegTwistOffset f] "
+               "[-rightLegTwistOffset f] [-repeat n] [-benchmark] clip.cmtm [clip.cmtm ...]"
+            << std::endl;
+}
+
+static bool parseArguments(int argc, char* argv[], Options& options) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "-benchmark") {
+      options.benchmark = true;
+    } else if (arg[0] != '-') {
+      options.clips.push_back(arg);
+    } else if (!hasValue) {
+      std::cerr << arg << " requires a value" << std::endl;
+      return false;
+    } else if (arg == "-target") {
+      options.targetPath = argv[++i];
+    } else if (arg == "-output") {
+      options.outputDirectory = argv[++i];
+    } else if (arg == "-threads") {
+      options.threads = std::atoi(argv[++i]);
+    } else if (arg == "-repeat") {
+      options.repeat = std::atoi(argv[++i]);
+    } else if (arg == "-strideScale") {
+      options.parameters.strideScale = static_cast<float>(std::atof(argv[++i]));
+    } else if (arg == "-rootMotionScale") {
+      options.parameters.rootMotionScale = static_cast<float>(std::atof(argv[++i]));
+    } else if (arg == "-leftLegTwistOffset") {
+      options.parameters.leftLegTwistOffset = static_cast<float>(std::atof(argv[++i]));
+    } else if (arg == "-rightLegTwistOffset") {
+      options.parameters.rightLegTwistOffset = static_cast<float>(std::atof(argv[++i]));
+    } else {
+      std::cerr << "Unknown flag " << arg << std::endl;
+      return false;
+    }
+  }
+  if (options.targetPath.empty() || options.clips.empty()) {
+    return false;
+  }
+  if (!options.benchmark && options.outputDirectory.empty()) {
+    std::cerr << "-output is required unless running with -benchmark" << std::endl;
+    return false;
+  }
+  if (options.threads == 0) {
+    options.threads = 1;
+  }
+  if (options.repeat == 0) {
+    options.repeat = 1;
+  }
+  return true;
+}
+
+static std::string baseName(const std::string& path) {
+  size_t pos = path.find_last_of("/\\");
+  return pos == std::string::npos ? path : path.substr(pos + 1);
+}
+
+/**
+  Gets the output file name of each clip.  Clips with the same file name get a numbered suffix
+  so they do not overwrite each other in the output directory.
+  @param[in] clips Clip paths.
+  @return File name in the output directory of each clip.
+*/
+static std::vector<std::string> outputNames(const std::vector<std::string>& clips) {
+  std::vector<std::string> names;
+  std::set<std::string> used;
+  for (const std::string& clip : clips) {
+    std::string name = baseName(clip);
+    size_t dot = name.find_last_of('.');
+    std::string stem = dot == std::string::npos ? name : name.substr(0, dot);
+    std::string extension = dot == std::string::npos ? "" : name.substr(dot);
+    for (int suffix = 1; used.count(name); ++suffix) {
+      name = stem + "_" + std::to_string(suffix) + extension;
+    }
+    used.insert(name);
+    names.push_back(name);
+  }
+  return names;
+}
+
+/**
+  Retargets a single clip.
+  @param[in] source The source clip.
+  @param[in] targetRest The target rest pose.
+  @param[in] parameters Retarget settings.
+  @param[in] solver Solver to use.  It is reset before the clip is processed.
+  @param[out] output Storage for the retargeted clip.
+*/
+static void retargetClip(const MatrixStream& source, const IKRigSolver::MatrixArray& targetRest,
+                         const IKRigParameters& parameters, IKRigSolver& solver,
+                         MatrixStream& output) {
+  IKRigSolver::MatrixArray inputRest;
+  IKRigSolver::MatrixArray input;
+  for (unsigned int i = 0; i < IKRig_Count; ++i) {
+    inputRest[i] = source.rest[i];
+  }
+  output.resize(IKRig_Count + 1, source.frameCount);
+  output.frameRate = source.frameRate;
+  for (unsigned int i = 0; i < IKRig_Count; ++i) {
+    output.rest[i] = targetRest[i];
+  }
+
+  solver.reset();
+  for (unsigned int frame = 0; frame < source.frameCount; ++frame) {
+    for (unsigned int i = 0; i < IKRig_Count; ++i) {
+      input[i] = source.matrix(frame, i);
+    }
+    solver.solve(input, inputRest, targetRest, parameters);
+    for (unsigned int i = 0; i < IKRig_Count; ++i) {
+      output.matrix(frame, i) = solver.outputMatrix(i);
+    }
+    output.matrix(frame, IKRig_Count) = solver.rootMotion();
+  }
+}
+
+int main(int argc, char* argv[]) {
+  Options options;
+  if (!parseArguments(argc, argv, options)) {
+    usage();
+    return 1;
+  }
+
+  std::string error;
+  MatrixStream target;
+  if (!readMatrixStream(options.targetPath, target, error)) {
+    std::cerr << error << std::endl;
+    return 1;
+  }
+  if (target.matrixCount < IKRig_Count) {
+    std::cerr << options.targetPath << " needs " << IKRig_Count << " rest matrices" << std::endl;
+    return 1;
+  }
+  IKRigSolver::MatrixArray targetRest;
+  for (unsigned int i = 0; i < IKRig_Count; ++i) {
+    targetRest[i] = target.rest[i];
+  }
+
+  std::vector<std::string> names = outputNames(options.clips);
+  size_t jobCount = options.clips.size() * options.repeat;
+  WorkQueue queue(jobCount);
+  std::atomic<size_t> framesProcessed(0);
+  std::atomic<size_t> failures(0);
+  std::mutex logMutex;
+
+  auto worker = [&]() {
+    IKRigSolver solver;
+    MatrixStream source;
+    MatrixStream output;
+    std::string error;
+    size_t job;
+    while (queue.pop(job)) {
+      size_t clip = job % options.clips.size();
+      const std::string& path = options.clips[clip];
+      bool ok = readMatrixStream(path, source, error);
+      if (ok && source.matrixCount < IKRig_Count) {
+        error = path + " needs " + std::to_string(IKRig_Count) + " matrices per frame";
+        ok = false;
+      }
+      if (ok) {
+        retargetClip(source, targetRest, options.parameters, solver, output);
+        framesProcessed += source.frameCount;
+        // Repeats produce the same result, writing it again would race on the same file
+        if (!options.benchmark && job < options.clips.size()) {
+          ok = writeMatrixStream(options.outputDirectory + "/" + names[clip], output, error);
+        }
+      }
+      if (!ok) {
+        ++failures;
+        std::lock_guard<std::mutex> lock(logMutex);
+        std::cerr << error << std::endl;
+      }
+    }
+  };
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (unsigned int i = 0; i < options.threads; ++i) {
+    threads.emplace_back(worker);
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  double seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  size_t clipsProcessed = jobCount - failures;
+  std::cout << "Retargeted " << clipsProcessed << " clips (" << framesProcessed << " frames) in "
+            << seconds << "s on " << options.threads << " threads" << std::endl;
+  if (seconds > 0.0) {
+    std::cout << "Throughput: " << clipsProcessed * 60.0 / seconds << " clips/min, "
+              << framesProcessed / seconds << " frames/s" << std::endl;
+  }
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,115 @@
+#include "matrixStream.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+
+static const char kMagic[4] = {'C', 'M', 'T', 'M'};
+static const uint32_t kVersion = 1;
+
+static bool readMatrix(std::ifstream& in, Eigen::Matrix4d& m) {
+  double values[16];
+  if (!in.read(reinterpret_cast<char*>(values), sizeof(values))) {
+    return false;
+  }
+  for (int r = 0; r < 4; ++r) {
+    for (int c = 0; c < 4; ++c) {
+      m(r, c) = values[r * 4 + c];
+    }
+  }
+  return true;
+}
+
+static void writeMatrix(std::ofstream& out, const Eigen::Matrix4d& m) {
+  double values[16];
+  for (int r = 0; r < 4; ++r) {
+    for (int c = 0; c < 4; ++c) {
+      values[r * 4 + c] = m(r, c);
+    }
+  }
+  out.write(reinterpret_cast<const char*>(values), sizeof(values));
+}
+
+void MatrixStream::resize(unsigned int matrices, unsigned int frames) {
+  matrixCount = matrices;
+  frameCount = frames;
+  rest.assign(matrixCount, Eigen::Matrix4d::Identity());
+  this->frames.assign(static_cast<size_t>(matrixCount) * frameCount, Eigen::Matrix4d::Identity());
+}
+
+bool readMatrixStream(const std::string& path, MatrixStream& stream, std::string& error) {
+  std::ifstream in(path.c_str(), std::ios::binary | std::ios::ate);
+  if (!in) {
+    error = "Unable to open " + path;
+    return false;
+  }
+  uint64_t size = static_cast<uint64_t>(in.tellg());
+  in.seekg(0);
+  char magic[4];
+  uint32_t version, matrixCount, frameCount;
+  double frameRate;
+  in.read(magic, sizeof(magic));
+  in.read(reinterpret_cast<char*>(&version), sizeof(version));
+  in.read(reinterpret_cast<char*>(&matrixCount), sizeof(matrixCount));
+  in.read(reinterpret_cast<char*>(&frameCount), sizeof(frameCount));
+  in.read(reinterpret_cast<char*>(&frameRate), sizeof(frameRate));
+  if (!in || std::memcmp(magic, kMagic, sizeof(kMagic)) != 0) {
+    error = path + " is not a matrix stream file";
+    return false;
+  }
+  if (version != kVersion) {
+    error = path + " has unsupported version " + std::to_string(version);
+    return false;
+  }
+  // Checking the counts against the file size keeps a corrupt header from allocating huge buffers
+  uint64_t headerSize = sizeof(magic) + sizeof(version) + sizeof(matrixCount) +
+                        sizeof(frameCount) + sizeof(frameRate);
+  uint64_t matrixSize = 16 * sizeof(double);
+  uint64_t expected =
+      headerSize + matrixSize * matrixCount * (static_cast<uint64_t>(frameCount) + 1);
+  if (size != expected) {
+    error = path + " does not match the size given by its header";
+    return false;
+  }
+  stream.resize(matrixCount, frameCount);
+  stream.frameRate = frameRate;
+  for (auto& m : stream.rest) {
+    if (!readMatrix(in, m)) {
+      error = path + " is truncated";
+      return false;
+    }
+  }
+  for (auto& m : stream.frames) {
+    if (!readMatrix(in, m)) {
+      error = path + " is truncated";
+      return false;
+    }
+  }
+  return true;
+}
+
+bool writeMatrixStream(const std::string& path, const MatrixStream& stream, std::string& error) {
+  std::ofstream out(path.c_str(), std::ios::binary);
+  if (!out) {
+    error = "Unable to open " + path + " for writing";
+    return false;
+  }
+  uint32_t matrixCount = stream.matrixCount;
+  uint32_t frameCount = stream.frameCount;
+  out.write(kMagic, sizeof(kMagic));
+  out.write(reinterpret_cast<const char*>(&kVersion), sizeof(kVersion));
+  out.write(reinterpret_cast<const char*>(&matrixCount), sizeof(matrixCount));
+  out.write(reinterpret_cast<const char*>(&frameCount), sizeof(frameCount));
+  out.write(reinterpret_cast<const char*>(&stream.frameRate), sizeof(stream.frameRate));
+  for (const auto& m : stream.rest) {
+    writeMatrix(out, m);
+  }
+  for (const auto& m : stream.frames) {
+    writeMatrix(out, m);
+  }
+  if (!out) {
+    error = "Failed writing " + path;
+    return false;
+  }
+  return true;
+}
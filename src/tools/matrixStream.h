@@ -0,0 +1,64 @@
+#ifndef CMT_MATRIXSTREAM_H
+#define CMT_MATRIXSTREAM_H
+
+#include <Eigen/Dense>
+
+#include <string>
+#include <vector>
+
+/**
+  Simple binary matrix stream used to move skeleton animation in and out of the offline tools.
+
+  Layout (little endian):
+    char[4]  magic "CMTM"
+    uint32   version
+    uint32   matrixCount   Matrices per frame
+    uint32   frameCount
+    double   frameRate
+    double[16] * matrixCount                 Rest matrices
+    double[16] * matrixCount * frameCount    Animation, frame major
+
+  Matrices are world space and stored row major in the Maya row vector convention, so the
+  values are in the same order as MMatrix::get / cmds.getAttr(".worldMatrix").
+*/
+struct MatrixStream {
+  MatrixStream() : matrixCount(0), frameCount(0), frameRate(30.0) {}
+
+  const Eigen::Matrix4d& matrix(unsigned int frame, unsigned int index) const {
+    return frames[frame * matrixCount + index];
+  }
+  Eigen::Matrix4d& matrix(unsigned int frame, unsigned int index) {
+    return frames[frame * matrixCount + index];
+  }
+
+  /**
+    Resizes the stream and resets all the matrices to identity.
+  */
+  void resize(unsigned int matrices, unsigned int frameCount);
+
+  unsigned int matrixCount;
+  unsigned int frameCount;
+  double frameRate;
+  std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>> rest;
+  std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>> frames;
+};
+
+/**
+  Reads a matrix stream file.
+  @param[in] path File path.
+  @param[out] stream Storage for the file contents.
+  @param[out] error Error description on failure.
+  @return true on success.
+*/
+bool readMatrixStream(const std::string& path, MatrixStream& stream, std::string& error);
+
+/**
+  Writes a matrix stream file.
+  @param[in] path File path.
+  @param[in] stream The stream to write.
+  @param[out] error Error description on failure.
+  @return true on success.
+*/
+bool writeMatrixStream(const std::string& path, const MatrixStream& stream, std::string& error);
+
+#endif
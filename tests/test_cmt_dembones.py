@@ -0,0 +1,293 @@
+import struct
+
+import maya.cmds as cmds
+import cmt.deform.dembones as dembones
+
+from cmt.test import TestCase
+
+
+class DemBonesTests(TestCase):
+    def setUp(self):
+        self.mesh = cmds.polyCube()[0]
+        cmds.setKeyframe(self.mesh, attribute="tx", t=1, v=0)
+        cmds.setKeyframe(self.mesh, attribute="tx", t=3, v=10)
+
+    def test_export_point_cache(self):
+        file_path = self.get_temp_filename("cube.cmtp")
+        dembones.export_point_cache(self.mesh, file_path, start=1, end=3)
+        with open(file_path, "rb") as fh:
+            data = fh.read()
+        self.assertEqual(data[:4], b"CMTP")
+        version, vertex_count, frame_count, start, frame_rate = struct.unpack(
+            "<IIIdd", data[4:32]
+        )
+        self.assertEqual(version, dembones.POINT_CACHE_VERSION)
+        self.assertEqual(vertex_count, 8)
+        self.assertEqual(frame_count, 3)
+        self.assertEqual(start, 1.0)
+        self.assertEqual(len(data), 32 + 8 * 3 * 3 * 4)
+
+        # First vertex of the first and last frames
+        rest = cmds.xform("{}.vtx[0]".format(self.mesh), q=True, os=True, t=True)
+        first = struct.unpack("<3f", data[32:44])
+        last_offset = 32 + 2 * 8 * 3 * 4
+        last = struct.unpack("<3f", data[last_offset : last_offset + 12])
+        self.assertListAlmostEqual(first, rest, places=5)
+        self.assertListAlmostEqual(last, [rest[0] + 10.0, rest[1], rest[2]], places=5)
+
+    def test_background_job(self):
+        cmds.loadPlugin("cmt", qt=True)
+        job = cmds.demBones(
+            self.mesh, bones=2, startFrame=1, endFrame=3, iters=2, background=True
+        )
+        self.assertIn(job, cmds.demBones(listJobs=True))
+        status = dembones.wait_for_job(job, timeout=60)
+        if status == "finished":
+            iteration, iterations, rmse = cmds.demBones(jobProgress=job)
+            self.assertEqual(iteration, iterations)
+            cmds.demBones(commitJob=job)
+        self.assertNotIn(job, cmds.demBones(listJobs=True) or [])
+        self.assertEqual(len(cmds.ls("dembones_joint*", type="joint")), 2)
+
+    def test_commit_job_with_deleted_mesh(self):
+        cmds.loadPlugin("cmt", qt=True)
+        job = cmds.demBones(
+            self.mesh, bones=2, startFrame=1, endFrame=3, iters=2, background=True
+        )
+        cmds.delete(self.mesh)
+        status = dembones.wait_for_job(job, timeout=60)
+        if status == "finished":
+            self.assertRaises(RuntimeError, cmds.demBones, commitJob=job)
+            self.assertEqual(cmds.demBones(jobStatus=job), "failed")
+        self.assertEqual(cmds.ls("dembones_joint*", type="joint"), [])
+        # The commit queued on idle skips jobs that are no longer waiting to be committed
+        cmds.demBones(commitFinished=job)
+        cmds.demBones(commitFinished=job + 1000)
+
+    def test_multires_solve(self):
+        cmds.loadPlugin("cmt", qt=True)
+        joints = cmds.demBones(
+            self.mesh, bones=2, startFrame=1, endFrame=3, iters=2, multiRes=0.5
+        )
+        self.assertEqual(len(joints), 2)
+        self.assertEqual(len(cmds.ls(type="skinCluster")), 1)
+
+    def test_kmeans_init(self):
+        cmds.loadPlugin("cmt", qt=True)
+        joints = cmds.demBones(
+            self.mesh, bones=2, startFrame=1, endFrame=3, iters=2, initMethod="kmeans"
+        )
+        self.assertEqual(len(joints), 2)
+        self.assertEqual(len(cmds.ls(type="skinCluster")), 1)
+        with self.assertRaises(RuntimeError):
+            cmds.demBones(self.mesh, bones=2, initMethod="random")
+
+    def test_frame_budget(self):
+        cmds.loadPlugin("cmt", qt=True)
+        cmds.setKeyframe(self.mesh, attribute="tx", t=10, v=-10)
+        joints = cmds.demBones(
+            self.mesh, bones=2, startFrame=1, endFrame=10, iters=2, frameBudget=4
+        )
+        self.assertEqual(len(joints), 2)
+        count = cmds.keyframe(joints[0], attribute="tx", q=True, keyframeCount=True)
+        self.assertEqual(count, 10)
+
+    def test_iterative_smooth(self):
+        cmds.loadPlugin("cmt", qt=True)
+        joints = cmds.demBones(
+            self.mesh, bones=2, startFrame=1, endFrame=3, iters=2, iterativeSmooth=True
+        )
+        self.assertEqual(len(joints), 2)
+        self.assertEqual(len(cmds.ls(type="skinCluster")), 1)
+
+    def test_multiple_subjects(self):
+        cmds.loadPlugin("cmt", qt=True)
+        cmds.setKeyframe(self.mesh, attribute="tx", t=10, v=0)
+        cmds.setKeyframe(self.mesh, attribute="tx", t=12, v=-10)
+        joints = cmds.demBones(
+            self.mesh, bones=2, startFrame=[1, 10], endFrame=[3, 12], iters=2
+        )
+        self.assertEqual(len(joints), 2)
+        self.assertEqual(len(cmds.ls(type="skinCluster")), 1)
+        times = cmds.keyframe(joints[0], attribute="tx", q=True, timeChange=True)
+        self.assertListAlmostEqual(times, [1, 2, 3, 10, 11, 12])
+
+    def test_multiple_point_caches(self):
+        cmds.loadPlugin("cmt", qt=True)
+        first = self.get_temp_filename("first.cmtp")
+        second = self.get_temp_filename("second.cmtp")
+        dembones.export_point_cache(self.mesh, first, start=1, end=2)
+        dembones.export_point_cache(self.mesh, second, start=5, end=7)
+        joints = cmds.demBones(self.mesh, bones=2, cacheFile=[first, second], iters=2)
+        times = cmds.keyframe(joints[0], attribute="tx", q=True, timeChange=True)
+        self.assertListAlmostEqual(times, [1, 2, 5, 6, 7])
+
+    def test_point_cache_frame_rate(self):
+        cmds.loadPlugin("cmt", qt=True)
+        file_path = self.get_temp_filename("cube.cmtp")
+        dembones.export_point_cache(self.mesh, file_path, start=1, end=3)
+        unit = cmds.currentUnit(q=True, time=True)
+        cmds.currentUnit(time="pal" if unit != "pal" else "ntsc")
+        try:
+            self.assertRaises(
+                RuntimeError,
+                cmds.demBones,
+                self.mesh,
+                bones=2,
+                cacheFile=file_path,
+                iters=2,
+            )
+        finally:
+            cmds.currentUnit(time=unit)
+
+    def test_key_reduction(self):
+        cmds.loadPlugin("cmt", qt=True)
+        cmds.setKeyframe(self.mesh, attribute="tx", t=10, v=10)
+        joints = cmds.demBones(
+            self.mesh, bones=2, startFrame=1, endFrame=10, iters=2, keyTolerance=0.01
+        )
+        for joint in joints:
+            for attribute in ["rx", "tx"]:
+                count = cmds.keyframe(
+                    joint, attribute=attribute, q=True, keyframeCount=True
+                )
+                self.assertGreater(count, 0)
+                self.assertLess(count, 10)
+
+    def test_key_reduction_multiple_subjects(self):
+        cmds.loadPlugin("cmt", qt=True)
+        cmds.setKeyframe(self.mesh, attribute="tx", t=20, v=10)
+        cmds.setKeyframe(self.mesh, attribute="tx", t=25, v=20)
+        cmds.keyTangent(self.mesh, attribute="tx", itt="linear", ott="linear")
+        # The first subject holds still, the second one moves
+        joints = cmds.demBones(
+            self.mesh,
+            bones=2,
+            startFrame=[4, 20],
+            endFrame=[8, 25],
+            iters=2,
+            keyTolerance=0.01,
+        )
+        for joint in joints:
+            for attribute in ["rx", "ry", "rz", "tx", "ty", "tz"]:
+                plug = "{}.{}".format(joint, attribute)
+                rest = cmds.getAttr(plug, time=4)
+                for frame in range(5, 9):
+                    self.assertAlmostEqual(cmds.getAttr(plug, time=frame), rest, places=1)
+
+    def test_checkpoint_resume(self):
+        cmds.loadPlugin("cmt", qt=True)
+        cache_path = self.get_temp_filename("cube.cmtp")
+        checkpoint_path = self.get_temp_filename("cube.cmtk")
+        dembones.export_point_cache(self.mesh, cache_path, start=1, end=3)
+        joints = cmds.demBones(
+            self.mesh,
+            bones=2,
+            cacheFile=cache_path,
+            iters=2,
+            checkpoint=checkpoint_path,
+            checkpointInterval=1,
+        )
+        with open(checkpoint_path, "rb") as fh:
+            self.assertEqual(fh.read(4), b"CMTK")
+        cmds.delete(joints)
+        joints = cmds.demBones(
+            self.mesh, cacheFile=cache_path, iters=4, resume=checkpoint_path
+        )
+        self.assertEqual(len(joints), 2)
+
+    def test_checkpoint_header_mismatch(self):
+        cmds.loadPlugin("cmt", qt=True)
+        cache_path = self.get_temp_filename("cube.cmtp")
+        checkpoint_path = self.get_temp_filename("cube.cmtk")
+        dembones.export_point_cache(self.mesh, cache_path, start=1, end=3)
+        joints = cmds.demBones(
+            self.mesh,
+            bones=2,
+            cacheFile=cache_path,
+            iters=2,
+            checkpoint=checkpoint_path,
+            checkpointInterval=1,
+        )
+        cmds.delete(joints)
+        with open(checkpoint_path, "rb") as fh:
+            data = fh.read()
+        # magic, version, iteration, nV, nF and nS come before nB
+        nb_offset = 24
+        corrupt = data[:nb_offset] + struct.pack("<i", 3) + data[nb_offset + 4 :]
+        with open(checkpoint_path, "wb") as fh:
+            fh.write(corrupt)
+        self.assertRaises(
+            RuntimeError,
+            cmds.demBones,
+            self.mesh,
+            cacheFile=cache_path,
+            iters=4,
+            resume=checkpoint_path,
+        )
+
+    def test_existing_skin_weights(self):
+        cmds.loadPlugin("cmt", qt=True)
+        cmds.select(cl=True)
+        root = cmds.joint(p=(0, -1, 0))
+        tip = cmds.joint(p=(0, 1, 0))
+        cmds.setKeyframe(tip, attribute="rx", t=1, v=0)
+        cmds.setKeyframe(tip, attribute="rx", t=3, v=45)
+        skin = cmds.skinCluster(root, tip, self.mesh, tsb=True)[0]
+
+        # Without iterations the result is the starting point
+        cmds.demBones(
+            self.mesh, existingBones=[root, tip], startFrame=1, endFrame=3, iters=0
+        )
+        new_skin = [s for s in cmds.ls(type="skinCluster") if s != skin][0]
+        new_mesh = cmds.skinCluster(new_skin, q=True, geometry=True)[0]
+        for i in range(8):
+            expected = cmds.skinPercent(
+                skin, "{}.vtx[{}]".format(self.mesh, i), q=True, value=True
+            )
+            actual = cmds.skinPercent(
+                new_skin, "{}.vtx[{}]".format(new_mesh, i), q=True, value=True
+            )
+            self.assertListAlmostEqual(actual, expected, places=5)
+
+    def test_existing_skin_weights_with_added_bones(self):
+        cmds.loadPlugin("cmt", qt=True)
+        cmds.select(cl=True)
+        root = cmds.joint(p=(0, -1, 0))
+        tip = cmds.joint(p=(0, 1, 0))
+        cmds.setKeyframe(tip, attribute="rx", t=1, v=0)
+        cmds.setKeyframe(tip, attribute="rx", t=3, v=45)
+        skin = cmds.skinCluster(root, tip, self.mesh, tsb=True)[0]
+
+        # The skin weights only cover the existing bones so the added bone starts the solve
+        cmds.demBones(
+            self.mesh,
+            existingBones=[root, tip],
+            bones=1,
+            startFrame=1,
+            endFrame=3,
+            iters=2,
+        )
+        new_skin = [s for s in cmds.ls(type="skinCluster") if s != skin][0]
+        self.assertEqual(len(cmds.skinCluster(new_skin, q=True, influence=True)), 3)
+
+    def test_sparse_skin_weights(self):
+        cmds.loadPlugin("cmt", qt=True)
+        cmds.demBones(
+            self.mesh, bones=3, startFrame=1, endFrame=3, iters=2, maxInfluences=1
+        )
+        skin = cmds.ls(type="skinCluster")[0]
+        for i in range(8):
+            plug = "{}.weightList[{}].weights".format(skin, i)
+            self.assertEqual(len(cmds.getAttr(plug, multiIndices=True)), 1)
+
+    def test_skin_max_influences(self):
+        cmds.loadPlugin("cmt", qt=True)
+        cmds.demBones(
+            self.mesh, bones=3, startFrame=1, endFrame=3, iters=2, maxInfluences=2
+        )
+        skin = cmds.ls(type="skinCluster")[0]
+        self.assertEqual(cmds.getAttr("{}.maxInfluences".format(skin)), 2)
+        for i in range(8):
+            plug = "{}.weightList[{}].weights".format(skin, i)
+            self.assertLessEqual(len(cmds.getAttr(plug, multiIndices=True)), 2)
@@ -80,3 +80,192 @@ class TwistDecompositionTests(TestCase):
         )
         tm.translateBy(OpenMaya.MVector(self.tx, 0, 0), OpenMaya.MSpace.kTransform)
         self.assertListAlmostEqual(m, tm.asMatrix())
+
+    def test_create_from_selection(self):
+        cmds.loadPlugin("cmt", qt=True)
+        cmds.select(self.start_joint, self.twist_joint)
+        node = cmds.swingTwist(name="selectionTwist", twist=-1.0, swing=0.0)
+        self.assertEqual(cmds.nodeType(node), "swingTwist")
+        self.assertEqual(
+            cmds.listConnections("{}.driverMatrix".format(node), plugs=True),
+            ["{}.matrix".format(self.start_joint)],
+        )
+        self.assertTrue(
+            cmds.isConnected(
+                "{}.outMatrix".format(node), "{}.opm".format(self.twist_joint)
+            )
+        )
+
+    def test_array_node_matches_single_node(self):
+        cmds.loadPlugin("cmt", qt=True)
+        cmds.setAttr("{}.r".format(self.start_joint), 20, 35, -10)
+        twist_joint2 = cmds.duplicate(self.twist_joint, name="twist_joint2")[0]
+        single = cmds.swingTwist(self.start_joint, self.twist_joint, twist=0.5, swing=0.25)
+        node = st.create_swing_twist_array(
+            [(self.start_joint, twist_joint2)], twist_weight=0.5, swing_weight=0.25
+        )
+        self.assertEqual(cmds.nodeType(node), "swingTwistArray")
+        for rotation in [(45, 0, 0), (10, 70, 30), (-80, 15, 90)]:
+            cmds.setAttr("{}.r".format(self.start_joint), *rotation)
+            expected = cmds.getAttr("{}.outMatrix".format(single))
+            actual = cmds.getAttr("{}.outMatrix[0]".format(node))
+            self.assertListAlmostEqual(actual, expected)
+
+    def test_array_node_multiple_pairs(self):
+        cmds.loadPlugin("cmt", qt=True)
+        twist_joints = [
+            cmds.duplicate(self.twist_joint, name="twist_joint{}".format(i))[0]
+            for i in range(3)
+        ]
+        node = st.create_swing_twist_array(
+            [(self.start_joint, j) for j in twist_joints], twist_weight=1.0, swing_weight=0
+        )
+        self.assertEqual(cmds.getAttr("{}.outMatrix".format(node), size=True), 3)
+        cmds.setAttr("{}.rx".format(self.start_joint), 45)
+        for i, joint in enumerate(twist_joints):
+            self.assertTrue(
+                cmds.isConnected(
+                    "{}.outMatrix[{}]".format(node, i), "{}.opm".format(joint)
+                )
+            )
+
+    def test_array_node_removed_pair_output(self):
+        cmds.loadPlugin("cmt", qt=True)
+        twist_joints = [
+            cmds.duplicate(self.twist_joint, name="twist_joint{}".format(i))[0]
+            for i in range(3)
+        ]
+        node = st.create_swing_twist_array(
+            [(self.start_joint, j) for j in twist_joints], twist_weight=1.0, swing_weight=0
+        )
+        cmds.removeMultiInstance("{}.driverMatrix[1]".format(node), b=True)
+        cmds.setAttr("{}.rx".format(self.start_joint), 45)
+        cmds.getAttr("{}.outMatrix[0]".format(node))
+        indices = cmds.getAttr("{}.outMatrix".format(node), multiIndices=True)
+        self.assertEqual(indices, [0, 2])
+
+    def test_array_node_shared_driver(self):
+        cmds.loadPlugin("cmt", qt=True)
+        twist_joints = [
+            cmds.duplicate(self.twist_joint, name="twist_joint{}".format(i))[0]
+            for i in range(3)
+        ]
+        weights = [0.25, 0.5, 1.0]
+        objects = [node for j in twist_joints for node in (self.start_joint, j)]
+        node = cmds.swingTwist(objects, array=True, twist=weights, swing=0.0)
+        self.assertEqual(cmds.nodeType(node), "swingTwistArray")
+        self.assertEqual(cmds.getAttr("{}.outMatrix".format(node), size=True), 3)
+        cmds.setAttr("{}.rx".format(self.start_joint), 40)
+        pinv = OpenMaya.MMatrix(
+            cmds.getAttr("{}.worldInverseMatrix[0]".format(self.start_joint))
+        )
+        for i, (joint, weight) in enumerate(zip(twist_joints, weights)):
+            self.assertTrue(
+                cmds.isConnected(
+                    "{}.matrix".format(self.start_joint),
+                    "{}.driverMatrix[{}]".format(node, i),
+                )
+            )
+            self.assertTrue(
+                cmds.isConnected(
+                    "{}.outMatrix[{}]".format(node, i), "{}.opm".format(joint)
+                )
+            )
+            m = OpenMaya.MMatrix(cmds.getAttr("{}.worldMatrix[0]".format(joint)))
+            tm = OpenMaya.MTransformationMatrix()
+            tm.rotateBy(
+                OpenMaya.MEulerRotation(math.radians(40.0 * weight), 0, 0),
+                OpenMaya.MSpace.kTransform,
+            )
+            tm.translateBy(OpenMaya.MVector(self.tx, 0, 0), OpenMaya.MSpace.kTransform)
+            self.assertListAlmostEqual(m * pinv, tm.asMatrix())
+
+    def test_batch_creation(self):
+        cmds.loadPlugin("cmt", qt=True)
+        twist_joints = [
+            cmds.duplicate(self.twist_joint, name="twist_joint{}".format(i))[0]
+            for i in range(3)
+        ]
+        weights = [0.25, 0.5, 1.0]
+        nodes = st.create_swing_twists(
+            [(self.start_joint, j) for j in twist_joints],
+            twist_weight=weights,
+            swing_weight=0.0,
+        )
+        self.assertEqual(len(nodes), 3)
+        cmds.setAttr("{}.rx".format(self.start_joint), 40)
+        for node, joint, weight in zip(nodes, twist_joints, weights):
+            self.assertEqual(cmds.nodeType(node), "swingTwist")
+            self.assertAlmostEqual(cmds.getAttr("{}.twist".format(node)), weight)
+            m = OpenMaya.MMatrix(cmds.getAttr("{}.worldMatrix[0]".format(joint)))
+            pinv = OpenMaya.MMatrix(
+                cmds.getAttr("{}.worldInverseMatrix[0]".format(self.start_joint))
+            )
+            tm = OpenMaya.MTransformationMatrix()
+            tm.rotateBy(
+                OpenMaya.MEulerRotation(math.radians(40.0 * weight), 0, 0),
+                OpenMaya.MSpace.kTransform,
+            )
+            tm.translateBy(OpenMaya.MVector(self.tx, 0, 0), OpenMaya.MSpace.kTransform)
+            self.assertListAlmostEqual(m * pinv, tm.asMatrix())
+
+    def test_batch_creation_names(self):
+        cmds.loadPlugin("cmt", qt=True)
+        twist_joint2 = cmds.duplicate(self.twist_joint, name="twist_joint2")[0]
+        nodes = cmds.swingTwist(
+            self.start_joint,
+            self.twist_joint,
+            self.start_joint,
+            twist_joint2,
+            name="forearmTwist",
+        )
+        self.assertEqual(nodes, ["forearmTwist1", "forearmTwist2"])
+
+    def test_twist_distribution(self):
+        cmds.loadPlugin("cmt", qt=True)
+        twist_joints = [
+            cmds.duplicate(self.twist_joint, name="twist_joint{}".format(i))[0]
+            for i in range(4)
+        ]
+        st.create_twist_distribution(self.start_joint, twist_joints, twist_weight=-1.0)
+        cmds.setAttr("{}.rx".format(self.start_joint), 80)
+        for i, joint in enumerate(twist_joints):
+            m = OpenMaya.MMatrix(cmds.getAttr("{}.worldMatrix[0]".format(joint)))
+            pinv = OpenMaya.MMatrix(
+                cmds.getAttr("{}.worldInverseMatrix[0]".format(self.start_joint))
+            )
+            tm = OpenMaya.MTransformationMatrix()
+            angle = -80.0 * (i + 1) / 4.0
+            tm.rotateBy(
+                OpenMaya.MEulerRotation(math.radians(angle), 0, 0),
+                OpenMaya.MSpace.kTransform,
+            )
+            tm.translateBy(OpenMaya.MVector(self.tx, 0, 0), OpenMaya.MSpace.kTransform)
+            self.assertListAlmostEqual(m * pinv, tm.asMatrix())
+
+    def test_twist_distribution_falloff_entries(self):
+        cmds.loadPlugin("cmt", qt=True)
+        node = st.create_twist_distribution(self.start_joint, [self.twist_joint])
+        duplicate = cmds.duplicate(node)[0]
+        for n in [node, duplicate]:
+            indices = cmds.getAttr("{}.distributionFalloff".format(n), multiIndices=True)
+            self.assertEqual(len(indices), 2)
+        empty = cmds.createNode("swingTwist")
+        self.assertFalse(
+            cmds.getAttr("{}.distributionFalloff".format(empty), multiIndices=True)
+        )
+
+    def test_twist_distribution_weights(self):
+        cmds.loadPlugin("cmt", qt=True)
+        st.create_twist_distribution(
+            self.start_joint, [self.twist_joint], twist_weight=-1.0, weights=[0.5]
+        )
+        cmds.setAttr("{}.rx".format(self.start_joint), 45)
+        m = self.local_matrix()
+        tm = OpenMaya.MTransformationMatrix()
+        tm.rotateBy(
+            OpenMaya.MEulerRotation(math.radians(-22.5), 0, 0),
+            OpenMaya.MSpace.kTransform,
+        )
+        tm.translateBy(OpenMaya.MVector(self.tx, 0, 0), OpenMaya.MSpace.kTransform)
+        self.assertListAlmostEqual(m, tm.asMatrix())